@@ -0,0 +1,95 @@
+#pragma once
+#include "table.hpp"
+
+// Lookup and enumeration adapters over every table in table.hpp, for wrappers
+// that work with any of them (FilteredTable, freeze). findValue returns
+// nullptr for a missing key; forEachEntry calls f(key, value) for each entry.
+template <typename KeyType, typename ValueType>
+ValueType* findValue(BaseTable<KeyType, ValueType>& table, const KeyType& key) {
+    if (table.getSize() == 0) {
+        return nullptr;
+    }
+    std::pair<KeyType, ValueType>* p = table.find(key).getPtr();
+    return p != table.end().getPtr() ? &p->second : nullptr;
+}
+
+template <typename KeyType, typename ValueType, typename Probing, typename Hash, typename KeyEqual>
+ValueType* findValue(HashTable<KeyType, ValueType, Probing, Hash, KeyEqual>& table, const KeyType& key) {
+    auto it = table.find(key);
+    return it != table.end() ? &it->second : nullptr;
+}
+
+template <typename KeyType, typename ValueType, size_t N, typename Table, typename KeyEqual>
+ValueType* findValue(SmallHashTable<KeyType, ValueType, N, Table, KeyEqual>& table, const KeyType& key) {
+    return table.find(key);
+}
+
+// The trees' own find throws on a miss, lookup does not
+template <typename KeyType, typename ValueType>
+ValueType* findValue(BinaryTree<KeyType, ValueType>& table, const KeyType& key) {
+    auto node = table.lookup(key);
+    return node != nullptr ? &node->value : nullptr;
+}
+
+template <typename KeyType, typename ValueType>
+ValueType* findValue(AVLTree<KeyType, ValueType>& table, const KeyType& key) {
+    auto node = table.lookup(key);
+    return node != nullptr ? &node->value : nullptr;
+}
+
+template <typename KeyType, typename ValueType>
+ValueType* findValue(RBTree<KeyType, ValueType>& table, const KeyType& key) {
+    auto node = table.lookup(key);
+    return node != nullptr ? &node->value : nullptr;
+}
+
+template <typename KeyType, typename ValueType, typename F>
+void forEachEntry(BaseTable<KeyType, ValueType>& table, F f) {
+    if (table.getSize() == 0) {
+        return;
+    }
+    for (std::pair<KeyType, ValueType>* p = table.begin().getPtr(); p != table.end().getPtr(); ++p) {
+        f(p->first, p->second);
+    }
+}
+
+template <typename KeyType, typename ValueType, typename Probing, typename Hash, typename KeyEqual, typename F>
+void forEachEntry(HashTable<KeyType, ValueType, Probing, Hash, KeyEqual>& table, F f) {
+    for (auto it = table.begin(); it != table.end(); ++it) {
+        f(it->first, it->second);
+    }
+}
+
+template <typename KeyType, typename ValueType, size_t N, typename Table, typename KeyEqual, typename F>
+void forEachEntry(SmallHashTable<KeyType, ValueType, N, Table, KeyEqual>& table, F f) {
+    table.forEach(f);
+}
+
+template <typename NodeType, typename F>
+void forEachNode(NodeType* node, F& f) {
+    if (node != nullptr) {
+        forEachNode(node->left, f);
+        f(node->key, node->value);
+        forEachNode(node->right, f);
+    }
+}
+
+template <typename KeyType, typename ValueType, typename F>
+void forEachEntry(BinaryTree<KeyType, ValueType>& table, F f) {
+    forEachNode(table.operator->(), f);
+}
+
+template <typename KeyType, typename ValueType, typename F>
+void forEachEntry(AVLTree<KeyType, ValueType>& table, F f) {
+    forEachNode(table.operator->(), f);
+}
+
+template <typename KeyType, typename ValueType, typename F>
+void forEachEntry(RBTree<KeyType, ValueType>& table, F f) {
+    forEachNode(table.operator->(), f);
+}
+
+template <typename Table, typename F>
+void forEachKey(Table& table, F f) {
+    forEachEntry(table, [&](const auto& key, auto&) { f(key); });
+}
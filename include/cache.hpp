@@ -0,0 +1,229 @@
+#pragma once
+#include "table.hpp"
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Eviction policies for BoundedTable
+struct ClockEviction {}; // one reference bit per entry, second chance
+struct SegmentedLru {};  // probation and protected segments, CLOCK driven
+
+// Heap bytes owned by a key or value, for byte budgets
+template <typename T>
+size_t heapBytes(const T&) {
+    return 0;
+}
+
+inline size_t heapBytes(const std::string& s) {
+    return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+template <typename T>
+size_t heapBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+// What an entry is charged against a byte budget: its own size and the heap
+// bytes of its key and value. The table's per-entry overhead is not counted.
+template <typename KeyType, typename ValueType>
+struct EntryWeight {
+    size_t operator()(const KeyType& key, const ValueType& value) const {
+        return sizeof(KeyType) + sizeof(ValueType) + heapBytes(key) + heapBytes(value);
+    }
+};
+
+// HashTable for caches: holds at most maxEntries entries and maxBytes bytes
+// (as Weight counts them; 0 - no limit) and evicts to make room.
+//
+// A hit only sets the entry's reference bit, with a relaxed atomic store, so
+// find() changes nothing else and readers under a shared lock may call it
+// concurrently; insert, insert_or_assign and remove need exclusive access.
+// Victims are picked by a clock hand sweeping the entries:
+//  - ClockEviction: a referenced entry loses its bit and survives the lap.
+//  - SegmentedLru: new entries are on probation; one referenced when the
+//    hand passes is promoted to the protected segment (up to 4/5 of the
+//    entries). A protected entry that was not used since is demoted instead
+//    of evicted, so entries hit once are evicted before the ones in use and
+//    a scan of one-off keys cannot flush them.
+template <typename KeyType, typename ValueType, typename Eviction = ClockEviction,
+          typename Hash = TableHash<KeyType>, typename KeyEqual = TableKeyEqual<KeyType>,
+          typename Weight = EntryWeight<KeyType, ValueType>>
+class BoundedTable {
+private:
+    struct Cell {
+        ValueType value;
+        std::atomic<uint8_t> referenced;
+        bool isProtected;
+        size_t slot;   // position in ring
+        size_t weight;
+
+        explicit Cell(const ValueType& v) : value(v), referenced(0), isProtected(false), slot(0), weight(0) {}
+    };
+    typedef std::pair<KeyType, Cell> Entry;
+
+    // StableChaining: entries keep their address, so the ring points at them
+    HashTable<KeyType, Cell, StableChaining, Hash, KeyEqual> table;
+    std::vector<Entry*> ring;
+    size_t hand;
+    size_t maxEntries;
+    size_t maxBytes;
+    size_t bytes_;
+    size_t protectedCount;
+    size_t evictions_;
+    Weight weigher;
+
+    static constexpr bool segmented = std::is_same<Eviction, SegmentedLru>::value;
+public:
+    BoundedTable(size_t entries, size_t bytes = 0, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual())
+        : table(0, hash, keyEqual), hand(0), maxEntries(entries), maxBytes(bytes), bytes_(0), protectedCount(0), evictions_(0) {
+        if (entries == 0 && bytes == 0) {
+            throw std::runtime_error("Invalid capacity!");
+        }
+        if (entries != 0) {
+            table.reserve(entries);
+            ring.reserve(entries);
+        }
+    }
+    BoundedTable(const BoundedTable&) = delete;
+    BoundedTable& operator=(const BoundedTable&) = delete;
+    size_t size() const {
+        return ring.size();
+    }
+    // Bytes charged by Weight for the entries held
+    size_t bytes() const {
+        return bytes_;
+    }
+    // Entries evicted to make room so far
+    size_t evictions() const {
+        return evictions_;
+    }
+    // nullptr when the key is absent; a hit marks the entry as used
+    ValueType* find(const KeyType& key) {
+        auto it = table.find(key);
+        if (it == table.end()) {
+            return nullptr;
+        }
+        it->second.referenced.store(1, std::memory_order_relaxed);
+        return &it->second.value;
+    }
+    // Does not count as a use of the entry
+    bool contains(const KeyType& key) {
+        return table.find(key) != table.end();
+    }
+    ValueType& operator[](const KeyType& key) {
+        ValueType* value = find(key);
+        if (value == nullptr) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return *value;
+    }
+    // Inserts when the key is absent, evicting first if the table is full;
+    // false if it was already there. An entry heavier than maxBytes is still
+    // kept, alone.
+    bool insert(const KeyType& key, const ValueType& value) {
+        if (contains(key)) {
+            return false;
+        }
+        size_t weight = weigher(key, value);
+        while (!ring.empty() && over(1, weight)) {
+            evict();
+        }
+        Entry* entry = &*table.try_emplace(key, value).first;
+        entry->second.weight = weight;
+        bytes_ += weight;
+        // the new entry takes the hand's place and the hand moves past it, so
+        // it is looked at last; the entry it displaces goes to the end
+        entry->second.slot = ring.size();
+        ring.push_back(entry);
+        if (hand < ring.size() - 1) {
+            swapSlots(hand, ring.size() - 1);
+            hand++;
+        }
+        return true;
+    }
+    // True when the key was inserted, false when its value was replaced
+    bool insert_or_assign(const KeyType& key, const ValueType& value) {
+        auto it = table.find(key);
+        if (it == table.end()) {
+            return insert(key, value);
+        }
+        // the iterator is a position in the chain, which evictions shift
+        Entry* self = &*it;
+        Cell& cell = self->second;
+        bytes_ -= cell.weight;
+        cell.value = value;
+        cell.weight = weigher(key, value);
+        bytes_ += cell.weight;
+        cell.referenced.store(1, std::memory_order_relaxed);
+        while (ring.size() > 1 && over(0, 0)) {
+            evict(self);
+        }
+        return false;
+    }
+    // False when the key was absent
+    bool remove(const KeyType& key) {
+        auto it = table.find(key);
+        if (it == table.end()) {
+            return false;
+        }
+        drop(it->second.slot);
+        return true;
+    }
+private:
+    bool over(size_t entries, size_t bytes) const {
+        return (maxEntries != 0 && ring.size() + entries > maxEntries) || (maxBytes != 0 && bytes_ + bytes > maxBytes);
+    }
+    // Moves the hand until it finds a victim other than keep. Every lap
+    // clears reference bits (and demotes), so this ends within two laps,
+    // three for SegmentedLru.
+    void evict(const Entry* keep = nullptr) {
+        for (;; hand++) {
+            if (hand >= ring.size()) {
+                hand = 0;
+            }
+            if (ring[hand] == keep) {
+                continue;
+            }
+            Cell& cell = ring[hand]->second;
+            bool referenced = cell.referenced.exchange(0, std::memory_order_relaxed) != 0;
+            if constexpr (segmented) {
+                if (referenced) {
+                    if (!cell.isProtected && protectedCount < ring.size() - ring.size() / 5) {
+                        cell.isProtected = true;
+                        protectedCount++;
+                    }
+                    continue;
+                }
+                if (cell.isProtected) {
+                    cell.isProtected = false;
+                    protectedCount--;
+                    continue;
+                }
+            }
+            else {
+                if (referenced) {
+                    continue;
+                }
+            }
+            drop(hand);
+            evictions_++;
+            return;
+        }
+    }
+    // Removes the entry in the ring slot; the last one fills the hole
+    void drop(size_t slot) {
+        Entry* entry = ring[slot];
+        bytes_ -= entry->second.weight;
+        protectedCount -= entry->second.isProtected;
+        swapSlots(slot, ring.size() - 1);
+        ring.pop_back();
+        table.remove(entry->first);
+    }
+    void swapSlots(size_t a, size_t b) {
+        std::swap(ring[a], ring[b]);
+        ring[a]->second.slot = a;
+        ring[b]->second.slot = b;
+    }
+};
@@ -0,0 +1,377 @@
+#pragma once
+#include "table.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+// HashTable split by hash into independently locked shards. Lookups take a
+// shared lock on one shard, updates an exclusive one, so threads working on
+// different shards never wait for each other.
+//
+// The shards never rehash incrementally (rehashStep stays 0), so find on a
+// shard does not modify it and may run under a shared lock.
+template <typename KeyType, typename ValueType, typename Probing = Chaining,
+          typename Hash = TableHash<KeyType>, typename KeyEqual = TableKeyEqual<KeyType>>
+class ConcurrentHashTable {
+private:
+    typedef HashTable<KeyType, ValueType, Probing, Hash, KeyEqual> Table;
+
+    // One cache line per lock, so that shards do not share them
+    struct alignas(64) Shard {
+        std::shared_mutex lock;
+        Table table;
+        Shard(int ptr, const Hash& hash, const KeyEqual& keyEqual) : table(ptr, hash, keyEqual) {}
+    };
+
+    Hash hasher;
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t mask;
+public:
+    // ptr is the initial bucket count of the whole table; the number of shards
+    // is rounded up to a power of two.
+    ConcurrentHashTable(int ptr = 0, size_t shardCount = 16, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash) {
+        size_t n = 1;
+        while (n < shardCount) {
+            n *= 2;
+        }
+        int perShard = static_cast<int>((ptr > 0 ? ptr : 0) / n);
+        for (size_t i = 0; i < n; i++) {
+            shards.emplace_back(new Shard(perShard, hash, keyEqual));
+        }
+        mask = n - 1;
+    }
+    ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+    ConcurrentHashTable& operator=(const ConcurrentHashTable&) = delete;
+
+    size_t shard_count() const {
+        return shards.size();
+    }
+    // Adds the pair unless the key is present; returns whether it was added
+    bool insert(const KeyType& key, const ValueType& value) {
+        return try_emplace(key, value);
+    }
+    template <typename... Args>
+    bool try_emplace(const KeyType& key, Args&&... args) {
+        Shard& shard = shardOf(key);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        return shard.table.try_emplace(key, std::forward<Args>(args)...).second;
+    }
+    // Returns true when the key was added, false when its value was replaced
+    template <typename M>
+    bool insert_or_assign(const KeyType& key, M&& obj) {
+        Shard& shard = shardOf(key);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        return shard.table.insert_or_assign(key, std::forward<M>(obj)).second;
+    }
+    // Copies the value out, since no reference into a shard stays valid once
+    // its lock is released
+    bool find(const KeyType& key, ValueType& value) {
+        Shard& shard = shardOf(key);
+        std::shared_lock<std::shared_mutex> guard(shard.lock);
+        auto it = shard.table.find(key);
+        if (it == shard.table.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+    bool contains(const KeyType& key) {
+        Shard& shard = shardOf(key);
+        std::shared_lock<std::shared_mutex> guard(shard.lock);
+        return shard.table.find(key) != shard.table.end();
+    }
+    bool remove(const KeyType& key) {
+        Shard& shard = shardOf(key);
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        return shard.table.remove(key);
+    }
+    // Holds every shard lock at once, so the count is a consistent snapshot
+    size_t size() {
+        std::vector<std::shared_lock<std::shared_mutex>> guards;
+        guards.reserve(shards.size());
+        size_t count = 0;
+        for (size_t i = 0; i < shards.size(); i++) {
+            guards.emplace_back(shards[i]->lock);
+            count += shards[i]->table.size();
+        }
+        return count;
+    }
+private:
+    // The hash is mixed again, so that the shard index and the bucket inside
+    // the shard come from different bits
+    Shard& shardOf(const KeyType& key) {
+        return *shards[static_cast<size_t>(hashMix(hasher(key))) & mask];
+    }
+};
+
+// Chained hash table whose readers take no locks: find, contains and
+// operator[] may run on any number of threads while one writer at a time
+// (writers are serialized by a mutex) inserts, removes and resizes.
+//
+// The writer never changes a node or a bucket array a reader may be looking
+// at. It links new nodes in with a single atomic store, replaces a node to
+// change its value and copies every node into a new bucket array to resize.
+// Unlinked storage is retired with the current epoch and freed once every
+// reader that might still see it has left.
+template <typename KeyType, typename ValueType,
+          typename Hash = TableHash<KeyType>, typename KeyEqual = TableKeyEqual<KeyType>>
+class ReadMostlyHashTable {
+private:
+    struct Node {
+        KeyType key;
+        ValueType value;
+        size_t hash;
+        std::atomic<Node*> next;
+        template <typename K, typename V>
+        Node(K&& key, V&& value, size_t hash, Node* next) : key(std::forward<K>(key)), value(std::forward<V>(value)), hash(hash), next(next) {}
+    };
+
+    struct Buckets {
+        size_t length;
+        std::atomic<Node*>* heads;
+        explicit Buckets(size_t length) : length(length), heads(new std::atomic<Node*>[length]) {
+            for (size_t i = 0; i < length; i++) {
+                heads[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        // Frees the nodes that are still linked as well
+        ~Buckets() {
+            for (size_t i = 0; i < length; i++) {
+                Node* node = heads[i].load(std::memory_order_relaxed);
+                while (node != nullptr) {
+                    Node* next = node->next.load(std::memory_order_relaxed);
+                    delete node;
+                    node = next;
+                }
+            }
+            delete[] heads;
+        }
+    };
+
+    // The epoch a reader entered with, 0 while it is outside. Each reader
+    // owns its slot for the duration of a lookup; the writer only reads it.
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{ 0 };
+    };
+
+    // Storage unlinked in epoch `epoch`: either a single node or a whole
+    // bucket array together with its nodes
+    struct Retired {
+        uint64_t epoch;
+        Node* node;
+        Buckets* buckets;
+    };
+
+    // Announces the reader in a free slot for as long as it lives
+    class ReadGuard {
+    private:
+        std::atomic<uint64_t>* slot;
+    public:
+        explicit ReadGuard(ReadMostlyHashTable& table) {
+            static std::atomic<size_t> nextHint{ 0 };
+            static thread_local size_t hint = nextHint.fetch_add(1, std::memory_order_relaxed);
+            size_t mask = table.readerCount - 1;
+            for (size_t i = hint & mask; ; i = (i + 1) & mask) {
+                uint64_t idle = 0;
+                if (table.readers[i].epoch.compare_exchange_strong(idle, table.epoch.load())) {
+                    slot = &table.readers[i].epoch;
+                    break;
+                }
+            }
+            // pairs with the fence in reclaim(): either the writer sees this
+            // slot, or this reader sees everything the writer unlinked
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        ~ReadGuard() {
+            slot->store(0, std::memory_order_release);
+        }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
+
+    Hash hasher;
+    KeyEqual equal;
+    std::atomic<Buckets*> buckets;
+    std::atomic<size_t> count;
+    std::atomic<uint64_t> epoch;
+    std::unique_ptr<ReaderSlot[]> readers;
+    size_t readerCount;
+    std::mutex writeLock;
+    std::vector<Retired> retired;
+public:
+    // maxReaders is rounded up to a power of two; more concurrent readers
+    // than that wait for a free slot.
+    ReadMostlyHashTable(int ptr = 0, size_t maxReaders = 64, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash), equal(keyEqual), count(0), epoch(1) {
+        buckets.store(new Buckets(ptr > 0 ? ptr : 1));
+        readerCount = 1;
+        while (readerCount < maxReaders) {
+            readerCount *= 2;
+        }
+        readers.reset(new ReaderSlot[readerCount]);
+    }
+    ReadMostlyHashTable(const ReadMostlyHashTable&) = delete;
+    ReadMostlyHashTable& operator=(const ReadMostlyHashTable&) = delete;
+    // No reader may be inside the table any more
+    ~ReadMostlyHashTable() {
+        for (size_t i = 0; i < retired.size(); i++) {
+            dispose(retired[i]);
+        }
+        delete buckets.load();
+    }
+
+    size_t size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+    size_t bucket_count() const {
+        return buckets.load()->length;
+    }
+    bool find(const KeyType& key, ValueType& value) {
+        ReadGuard guard(*this);
+        Node* node = lookup(key);
+        if (node == nullptr) {
+            return false;
+        }
+        value = node->value;
+        return true;
+    }
+    bool contains(const KeyType& key) {
+        ReadGuard guard(*this);
+        return lookup(key) != nullptr;
+    }
+    // Returns a copy: a node may be freed as soon as the reader has left
+    ValueType operator[](const KeyType& key) {
+        ReadGuard guard(*this);
+        Node* node = lookup(key);
+        if (node == nullptr) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return node->value;
+    }
+
+    // Adds the pair unless the key is present; returns whether it was added
+    bool insert(const KeyType& key, const ValueType& value) {
+        std::lock_guard<std::mutex> guard(writeLock);
+        size_t h = hasher(key);
+        Buckets* b = buckets.load(std::memory_order_relaxed);
+        if (findNode(b, key, h) != nullptr) {
+            return false;
+        }
+        link(b, new Node(key, value, h, nullptr));
+        if (count.fetch_add(1, std::memory_order_relaxed) + 1 > b->length) {
+            resize(b->length * 2);
+        }
+        return true;
+    }
+    // Returns true when the key was added, false when its value was replaced
+    template <typename M>
+    bool insert_or_assign(const KeyType& key, M&& obj) {
+        std::lock_guard<std::mutex> guard(writeLock);
+        size_t h = hasher(key);
+        Buckets* b = buckets.load(std::memory_order_relaxed);
+        std::atomic<Node*>* at = linkTo(b, key, h);
+        Node* old = at->load(std::memory_order_relaxed);
+        if (old == nullptr) {
+            link(b, new Node(key, std::forward<M>(obj), h, nullptr));
+            if (count.fetch_add(1, std::memory_order_relaxed) + 1 > b->length) {
+                resize(b->length * 2);
+            }
+            return true;
+        }
+        // readers may still be reading the old value, so the node is replaced
+        at->store(new Node(key, std::forward<M>(obj), h, old->next.load(std::memory_order_relaxed)), std::memory_order_release);
+        retire(old, nullptr);
+        return false;
+    }
+    bool remove(const KeyType& key) {
+        std::lock_guard<std::mutex> guard(writeLock);
+        Buckets* b = buckets.load(std::memory_order_relaxed);
+        std::atomic<Node*>* at = linkTo(b, key, hasher(key));
+        Node* node = at->load(std::memory_order_relaxed);
+        if (node == nullptr) {
+            return false;
+        }
+        at->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+        count.fetch_sub(1, std::memory_order_relaxed);
+        retire(node, nullptr);
+        return true;
+    }
+    // Rebuilds the table with at least the given number of buckets
+    void rehash(size_t length) {
+        std::lock_guard<std::mutex> guard(writeLock);
+        resize(std::max(length, size()));
+    }
+private:
+    Node* lookup(const KeyType& key) const {
+        return findNode(buckets.load(std::memory_order_acquire), key, hasher(key));
+    }
+    Node* findNode(Buckets* b, const KeyType& key, size_t h) const {
+        Node* node = b->heads[h % b->length].load(std::memory_order_acquire);
+        while (node != nullptr && !(node->hash == h && equal(node->key, key))) {
+            node = node->next.load(std::memory_order_acquire);
+        }
+        return node;
+    }
+    // The link that points at the key's node, or the null link at the end of
+    // its chain; writer only
+    std::atomic<Node*>* linkTo(Buckets* b, const KeyType& key, size_t h) {
+        std::atomic<Node*>* at = &b->heads[h % b->length];
+        Node* node = at->load(std::memory_order_relaxed);
+        while (node != nullptr && !(node->hash == h && equal(node->key, key))) {
+            at = &node->next;
+            node = at->load(std::memory_order_relaxed);
+        }
+        return at;
+    }
+    // The node is complete before the release store makes it reachable
+    void link(Buckets* b, Node* node) {
+        std::atomic<Node*>& head = b->heads[node->hash % b->length];
+        node->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        head.store(node, std::memory_order_release);
+    }
+    // Readers may be walking the old chains, so nodes are copied rather than
+    // relinked; the old array goes away with its nodes once they have left.
+    void resize(size_t length) {
+        Buckets* old = buckets.load(std::memory_order_relaxed);
+        Buckets* fresh = new Buckets(length > 0 ? length : 1);
+        for (size_t i = 0; i < old->length; i++) {
+            for (Node* node = old->heads[i].load(std::memory_order_relaxed); node != nullptr; node = node->next.load(std::memory_order_relaxed)) {
+                link(fresh, new Node(node->key, node->value, node->hash, nullptr));
+            }
+        }
+        buckets.store(fresh, std::memory_order_release);
+        retire(nullptr, old);
+    }
+    void retire(Node* node, Buckets* b) {
+        retired.push_back(Retired{ epoch.fetch_add(1), node, b });
+        if (retired.size() >= readerCount) {
+            reclaim();
+        }
+    }
+    // Frees what was retired before the oldest epoch a reader is still in
+    void reclaim() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t oldest = epoch.load();
+        for (size_t i = 0; i < readerCount; i++) {
+            uint64_t e = readers[i].epoch.load();
+            if (e != 0 && e < oldest) {
+                oldest = e;
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); i++) {
+            if (retired[i].epoch < oldest) {
+                dispose(retired[i]);
+            }
+            else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+    static void dispose(const Retired& item) {
+        delete item.node;
+        delete item.buckets;
+    }
+};
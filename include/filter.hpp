@@ -0,0 +1,225 @@
+#pragma once
+#include "adapters.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Membership filters that answer "definitely absent" for most missing keys
+// with a few bit probes. Both work on 64-bit key hashes and may report false
+// positives, never false negatives.
+
+// Blocked Bloom filter: a key sets one bit in each of the 8 words of a single
+// 512-bit block, so a probe touches one cache line. Keys can be added, but
+// not removed; FilteredTable rebuilds it when removals pile up.
+class BlockedBloomFilter {
+public:
+    static constexpr bool growable = true;
+    static constexpr size_t bitsPerKey = 12;
+
+    explicit BlockedBloomFilter(size_t keys = 0) {
+        reset(keys);
+    }
+    // Empties the filter and sizes it for the given number of keys
+    void reset(size_t keys) {
+        size_t blocks = 1;
+        while (blocks * 512 < keys * bitsPerKey) {
+            blocks *= 2;
+        }
+        bits.assign(blocks * 8, 0);
+        mask = blocks - 1;
+        capacity_ = blocks * 512 / bitsPerKey;
+    }
+    // Leaves room to grow to twice the given keys before the next rebuild
+    void build(const std::vector<uint64_t>& hashes) {
+        reset(hashes.size() * 2);
+        for (size_t i = 0; i < hashes.size(); i++) {
+            add(hashes[i]);
+        }
+    }
+    void add(uint64_t h) {
+        uint64_t* block = &bits[(h & mask) * 8];
+        uint64_t g = hashMix(h);
+        for (int i = 0; i < 8; i++) {
+            block[i] |= 1ull << ((g >> (6 * i)) & 63);
+        }
+    }
+    bool mayContain(uint64_t h) const {
+        const uint64_t* block = &bits[(h & mask) * 8];
+        uint64_t g = hashMix(h);
+        for (int i = 0; i < 8; i++) {
+            if (!((block[i] >> ((g >> (6 * i)) & 63)) & 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Keys the filter holds at its intended false positive rate
+    size_t capacity() const {
+        return capacity_;
+    }
+private:
+    std::vector<uint64_t> bits;
+    size_t mask;
+    size_t capacity_;
+};
+
+// Xor filter with 8-bit fingerprints (about 9.8 bits per key, 0.4% false
+// positives). Built once from the full key set; it cannot take new keys, so
+// it suits tables that no longer change.
+class XorFilter {
+public:
+    static constexpr bool growable = false;
+
+    XorFilter() : seed(0), segment(1), fingerprints(3, 0) {}
+    void build(std::vector<uint64_t> hashes) {
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        size_t n = hashes.size();
+        segment = (n + n / 4 + 32) / 3 + 1;
+        fingerprints.assign(segment * 3, 0);
+        std::vector<uint64_t> xors(segment * 3);
+        std::vector<uint32_t> counts(segment * 3);
+        std::vector<size_t> queue;
+        std::vector<std::pair<uint64_t, size_t>> order; // key and the slot it owns
+        for (seed = 1; ; seed++) {
+            std::fill(xors.begin(), xors.end(), 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t i = 0; i < n; i++) {
+                uint64_t k = keyOf(hashes[i]);
+                for (int j = 0; j < 3; j++) {
+                    size_t pos = slot(k, j);
+                    xors[pos] ^= k;
+                    counts[pos]++;
+                }
+            }
+            // peel slots that only one key maps to
+            queue.clear();
+            order.clear();
+            for (size_t pos = 0; pos < counts.size(); pos++) {
+                if (counts[pos] == 1) {
+                    queue.push_back(pos);
+                }
+            }
+            while (!queue.empty()) {
+                size_t pos = queue.back();
+                queue.pop_back();
+                if (counts[pos] != 1) {
+                    continue;
+                }
+                uint64_t k = xors[pos];
+                order.emplace_back(k, pos);
+                for (int j = 0; j < 3; j++) {
+                    size_t other = slot(k, j);
+                    xors[other] ^= k;
+                    if (--counts[other] == 1) {
+                        queue.push_back(other);
+                    }
+                }
+            }
+            if (order.size() == n) {
+                break;
+            }
+        }
+        // assign in reverse peeling order, so each key's own slot is free
+        for (size_t i = order.size(); i-- > 0; ) {
+            uint64_t k = order[i].first;
+            size_t pos = order[i].second;
+            fingerprints[pos] = 0;
+            fingerprints[pos] = fingerprint(k) ^ fingerprints[slot(k, 0)] ^ fingerprints[slot(k, 1)] ^ fingerprints[slot(k, 2)];
+        }
+    }
+    bool mayContain(uint64_t h) const {
+        uint64_t k = keyOf(h);
+        return fingerprint(k) == (fingerprints[slot(k, 0)] ^ fingerprints[slot(k, 1)] ^ fingerprints[slot(k, 2)]);
+    }
+private:
+    uint64_t seed;
+    size_t segment;
+    std::vector<uint8_t> fingerprints;
+
+    uint64_t keyOf(uint64_t h) const {
+        return hashMix(h ^ seed);
+    }
+    static uint8_t fingerprint(uint64_t k) {
+        return static_cast<uint8_t>(k ^ (k >> 32));
+    }
+    // Slot j of the key lies in segment j
+    size_t slot(uint64_t k, int j) const {
+        uint32_t part = static_cast<uint32_t>(j == 0 ? k : (k << (21 * j)) | (k >> (64 - 21 * j)));
+        return j * segment + static_cast<size_t>((static_cast<uint64_t>(part) * segment) >> 32);
+    }
+};
+
+// Any table with a membership filter in front: a lookup for a key the filter
+// rules out never reaches the table. With BlockedBloomFilter the filter
+// follows insert and remove; with XorFilter the table is filled through
+// table() and rebuild() is called once it is complete.
+template <typename KeyType, typename ValueType, typename Table = HashTable<KeyType, ValueType>,
+          typename Filter = BlockedBloomFilter, typename Hash = TableHash<KeyType>>
+class FilteredTable {
+private:
+    Table data;
+    Filter filter;
+    Hash hasher;
+    size_t added;   // keys added to the filter since it was built
+    size_t removed; // keys removed from the table since then
+public:
+    template <typename... Args>
+    explicit FilteredTable(Args&&... args) : data(std::forward<Args>(args)...) {
+        rebuild();
+    }
+    // Changes made here directly are not seen by the filter until rebuild()
+    Table& table() {
+        return data;
+    }
+    void insert(const KeyType& key, const ValueType& value) {
+        static_assert(Filter::growable, "this filter is immutable: fill table(), then call rebuild()");
+        data.insert(key, value);
+        filter.add(hasher(key));
+        if (++added > filter.capacity()) {
+            rebuild();
+        }
+    }
+    // Bloom filters cannot forget a key, so the filter is rebuilt once half
+    // of what it holds has been removed. Keys that only got past the filter
+    // as false positives are not counted.
+    void remove(const KeyType& key) {
+        static_assert(Filter::growable, "this filter is immutable: fill table(), then call rebuild()");
+        if (!filter.mayContain(hasher(key)) || findValue(data, key) == nullptr) {
+            return;
+        }
+        data.remove(key);
+        if (++removed * 2 > added) {
+            rebuild();
+        }
+    }
+    bool contains(const KeyType& key) {
+        return find(key) != nullptr;
+    }
+    // nullptr when the key is absent
+    ValueType* find(const KeyType& key) {
+        if (!filter.mayContain(hasher(key))) {
+            return nullptr;
+        }
+        return findValue(data, key);
+    }
+    ValueType& operator[](const KeyType& key) {
+        ValueType* value = find(key);
+        if (value == nullptr) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return *value;
+    }
+    // Whether the filter lets the key through to the table
+    bool mayContain(const KeyType& key) const {
+        return filter.mayContain(hasher(key));
+    }
+    void rebuild() {
+        std::vector<uint64_t> hashes;
+        forEachKey(data, [&](const KeyType& key) { hashes.push_back(hasher(key)); });
+        added = hashes.size();
+        removed = 0;
+        filter.build(std::move(hashes));
+    }
+};
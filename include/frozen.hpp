@@ -0,0 +1,243 @@
+#pragma once
+#include "adapters.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Read-only table over a minimal perfect hash (PTHash-style): keys are split
+// into buckets of about four (skewed, see bucket()), and each bucket gets a
+// pilot value that sends all of its keys to distinct free slots. The n
+// entries fill exactly n slots, so a lookup reads one pilot and compares one
+// entry.
+template <typename KeyType, typename ValueType, typename Hash = TableHash<KeyType>, typename KeyEqual = TableKeyEqual<KeyType>>
+class FrozenTable {
+private:
+    typedef std::pair<KeyType, ValueType> Entry;
+
+    Hash hasher;
+    KeyEqual equal;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> pilots;
+
+    static constexpr size_t keysPerBucket = 4;
+public:
+    // Empty; use freeze() to build one from a table
+    explicit FrozenTable(const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash), equal(keyEqual), pilots(1, 0) {}
+    // Takes the entries, keeping only the first of equal keys; throws if two
+    // different keys have the same hash, since no pilot can ever separate them
+    explicit FrozenTable(std::vector<Entry> items, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : FrozenTable(hash, keyEqual) {
+        build(items);
+    }
+    // nullptr when the key is absent
+    const ValueType* find(const KeyType& key) const {
+        if (entries.empty()) {
+            return nullptr;
+        }
+        uint64_t h = hashMix(hasher(key));
+        const Entry& entry = entries[slot(hashMix(h), hashMix(pilots[bucket(h)]), entries.size())];
+        return equal(entry.first, key) ? &entry.second : nullptr;
+    }
+    bool contains(const KeyType& key) const {
+        return find(key) != nullptr;
+    }
+    const ValueType& operator[](const KeyType& key) const {
+        const ValueType* value = find(key);
+        if (value == nullptr) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return *value;
+    }
+    size_t size() const {
+        return entries.size();
+    }
+    // Entries in slot order
+    typename std::vector<Entry>::const_iterator begin() const {
+        return entries.begin();
+    }
+    typename std::vector<Entry>::const_iterator end() const {
+        return entries.end();
+    }
+private:
+    // Maps x to [0, n) with a multiply instead of a division
+    static size_t reduce(uint64_t x, size_t n) {
+#if defined(__SIZEOF_INT128__)
+        return static_cast<size_t>((static_cast<__uint128_t>(x) * n) >> 64);
+#else
+        return static_cast<size_t>(x % n);
+#endif
+    }
+    // Skewed split: 60% of the keys go to the first 30% of the buckets, which
+    // are then placed while the table is nearly empty, leaving few keys for
+    // the small buckets at the end
+    size_t bucket(uint64_t h) const {
+        size_t dense = pilots.size() * 3 / 10 + 1;
+        uint64_t threshold = 0x9999999999999999ull; // 0.6 of 2^64
+        uint64_t low = (h << 32) | (h >> 32); // the high half decided the split
+        if (h < threshold) {
+            return reduce(low, dense);
+        }
+        return dense + reduce(low, pilots.size() - dense);
+    }
+    // h2 is the second hash of the key, hashMix of the one picking its
+    // bucket; mix is hashMix of the bucket's pilot. reduce() keeps the high
+    // bits, so the multiply folds the low ones in: otherwise keys that agree
+    // in their high bits would collide under every pilot.
+    static size_t slot(uint64_t h2, uint64_t mix, size_t length) {
+        return reduce((h2 ^ mix) * 0x9E3779B97F4A7C15ull, length);
+    }
+    // Keeps the first of equal keys; distinct keys with equal hashes throw
+    void dropDuplicates(std::vector<Entry>& items, std::vector<uint64_t>& hashes) const {
+        std::vector<size_t> byHash(items.size());
+        for (size_t i = 0; i < byHash.size(); i++) {
+            byHash[i] = i;
+        }
+        std::stable_sort(byHash.begin(), byHash.end(), [&](size_t a, size_t b) { return hashes[a] < hashes[b]; });
+        std::vector<bool> duplicate(items.size(), false);
+        size_t duplicates = 0;
+        for (size_t i = 1; i < byHash.size(); i++) {
+            size_t item = byHash[i];
+            if (hashes[item] != hashes[byHash[i - 1]]) {
+                continue;
+            }
+            bool same = false;
+            for (size_t j = i; j-- > 0 && hashes[byHash[j]] == hashes[item] && !same;) {
+                same = !duplicate[byHash[j]] && equal(items[byHash[j]].first, items[item].first);
+            }
+            if (!same) {
+                throw std::runtime_error("Keys with equal hashes!");
+            }
+            duplicate[item] = true;
+            duplicates++;
+        }
+        if (duplicates == 0) {
+            return;
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            if (duplicate[i]) {
+                continue;
+            }
+            if (kept != i) {
+                items[kept] = std::move(items[i]);
+                hashes[kept] = hashes[i];
+            }
+            kept++;
+        }
+        items.erase(items.begin() + kept, items.end());
+        hashes.erase(hashes.begin() + kept, hashes.end());
+    }
+    void build(std::vector<Entry>& items) {
+        std::vector<uint64_t> hashes(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            hashes[i] = hashMix(hasher(items[i].first));
+        }
+        dropDuplicates(items, hashes);
+        size_t n = items.size();
+        size_t bucketCount = n / keysPerBucket + 2;
+        pilots.assign(bucketCount, 0);
+        // group the keys by bucket, then place the largest buckets first,
+        // while most slots are still free
+        std::vector<size_t> offsets(bucketCount + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            offsets[bucket(hashes[i]) + 1]++;
+        }
+        for (size_t b = 0; b < bucketCount; b++) {
+            offsets[b + 1] += offsets[b];
+        }
+        std::vector<uint64_t> second(n);
+        for (size_t i = 0; i < n; i++) {
+            second[i] = hashMix(hashes[i]);
+        }
+        std::vector<size_t> members(n);
+        std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < n; i++) {
+            members[fill[bucket(hashes[i])]++] = i;
+        }
+        std::vector<size_t> order(bucketCount);
+        for (size_t b = 0; b < bucketCount; b++) {
+            order[b] = b;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return offsets[a + 1] - offsets[a] > offsets[b + 1] - offsets[b];
+        });
+
+        entries.clear();
+        entries.reserve(n);
+        // one bit per slot, so that the long pilot searches for the last
+        // buckets stay in cache
+        std::vector<bool> used(n, false);
+        std::vector<size_t> taken;
+        for (size_t b : order) {
+            if (offsets[b] == offsets[b + 1]) {
+                break;
+            }
+            for (uint32_t pilot = 0; ; pilot++) {
+                uint64_t mix = hashMix(pilot);
+                taken.clear();
+                for (size_t k = offsets[b]; k < offsets[b + 1]; k++) {
+                    size_t pos = slot(second[members[k]], mix, n);
+                    if (used[pos]) {
+                        break;
+                    }
+                    used[pos] = true;
+                    taken.push_back(pos);
+                }
+                if (taken.size() == offsets[b + 1] - offsets[b]) {
+                    pilots[b] = pilot;
+                    break;
+                }
+                for (size_t pos : taken) {
+                    used[pos] = false;
+                }
+                if (pilot == UINT32_MAX) {
+                    throw std::runtime_error("No pilot found!");
+                }
+            }
+        }
+        std::vector<size_t> source(n); // item placed in each slot
+        for (size_t i = 0; i < n; i++) {
+            source[slot(second[i], hashMix(pilots[bucket(hashes[i])]), n)] = i;
+        }
+        for (size_t pos = 0; pos < n; pos++) {
+            entries.push_back(std::move(items[source[pos]]));
+        }
+    }
+};
+
+// Copies the entries of any table into a FrozenTable. Hash tables keep their
+// hash and equality policies; the other tables use the defaults. Of a key
+// stored more than once (the chained HashTable, SimpleTable and SortTable
+// allow that) the first entry visited is kept.
+template <typename KeyType, typename ValueType, typename Table>
+std::vector<std::pair<KeyType, ValueType>> frozenEntries(Table& table) {
+    std::vector<std::pair<KeyType, ValueType>> items;
+    forEachEntry(table, [&](const KeyType& key, const ValueType& value) { items.emplace_back(key, value); });
+    return items;
+}
+
+template <typename KeyType, typename ValueType, typename Probing, typename Hash, typename KeyEqual>
+FrozenTable<KeyType, ValueType, Hash, KeyEqual> freeze(HashTable<KeyType, ValueType, Probing, Hash, KeyEqual>& table) {
+    return FrozenTable<KeyType, ValueType, Hash, KeyEqual>(frozenEntries<KeyType, ValueType>(table), table.hash_function(), table.key_eq());
+}
+
+template <typename KeyType, typename ValueType>
+FrozenTable<KeyType, ValueType> freeze(BaseTable<KeyType, ValueType>& table) {
+    return FrozenTable<KeyType, ValueType>(frozenEntries<KeyType, ValueType>(table));
+}
+
+template <typename KeyType, typename ValueType>
+FrozenTable<KeyType, ValueType> freeze(BinaryTree<KeyType, ValueType>& table) {
+    return FrozenTable<KeyType, ValueType>(frozenEntries<KeyType, ValueType>(table));
+}
+
+template <typename KeyType, typename ValueType>
+FrozenTable<KeyType, ValueType> freeze(AVLTree<KeyType, ValueType>& table) {
+    return FrozenTable<KeyType, ValueType>(frozenEntries<KeyType, ValueType>(table));
+}
+
+template <typename KeyType, typename ValueType>
+FrozenTable<KeyType, ValueType> freeze(RBTree<KeyType, ValueType>& table) {
+    return FrozenTable<KeyType, ValueType>(frozenEntries<KeyType, ValueType>(table));
+}
@@ -0,0 +1,257 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64) && !defined(__SIZEOF_INT128__)
+#include <intrin.h>
+#endif
+
+// Default hash policies for HashTable. Byte strings go through a wyhash-style
+// function (16 bytes per 64x64->128 multiply), integers through one multiply
+// mix, floating point keys through their bit pattern.
+
+// 64x64->128 multiply folded back to 64 bits
+inline uint64_t hashMum(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+inline uint64_t hashMix(uint64_t x) {
+    return hashMum(x ^ 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull);
+}
+
+inline uint64_t hashRead64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t hashRead32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t hashBytes(const void* data, size_t len, uint64_t seed = 0) {
+    const uint64_t s0 = 0xa0761d6478bd642full, s1 = 0xe7037ed1a0b428dbull;
+    const uint64_t s2 = 0x8ebc6af09c88c6e3ull, s3 = 0x589965cc75374cc3ull;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    seed ^= hashMum(seed ^ s0, s1);
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t mid = (len >> 3) << 2;
+            a = (hashRead32(p) << 32) | hashRead32(p + mid);
+            b = (hashRead32(p + len - 4) << 32) | hashRead32(p + len - 4 - mid);
+        }
+        else if (len > 0) {
+            a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = hashMum(hashRead64(p) ^ s1, hashRead64(p + 8) ^ seed);
+                see1 = hashMum(hashRead64(p + 16) ^ s2, hashRead64(p + 24) ^ see1);
+                see2 = hashMum(hashRead64(p + 32) ^ s3, hashRead64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = hashMum(hashRead64(p) ^ s1, hashRead64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = hashRead64(p + i - 16);
+        b = hashRead64(p + i - 8);
+    }
+    return hashMum(s1 ^ len, hashMum(a ^ s1, b ^ seed));
+}
+
+// Anything without a dedicated overload: std::hash, then a mixing step so
+// that identity hashes (std::hash<int> and friends) still spread.
+template <typename T, typename Enable = void>
+struct TableHash {
+    size_t operator()(const T& key) const {
+        return static_cast<size_t>(hashMix(std::hash<T>()(key)));
+    }
+};
+
+template <typename T>
+struct TableHash<T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type> {
+    size_t operator()(T key) const {
+        return static_cast<size_t>(hashMix(static_cast<uint64_t>(key)));
+    }
+};
+
+template <typename T>
+struct TableHash<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    // x87 long double keeps 10 bytes of value in a 12 or 16 byte object; the
+    // rest is padding with whatever was there
+    static constexpr size_t significant = std::numeric_limits<T>::digits == 64 ? 10 : sizeof(T);
+
+    size_t operator()(T key) const {
+        if (key == 0) {
+            key = 0; // -0.0 == 0.0, so they must hash alike
+        }
+        if constexpr (significant <= sizeof(uint64_t)) {
+            uint64_t bits = 0;
+            std::memcpy(&bits, &key, significant);
+            return static_cast<size_t>(hashMix(bits));
+        }
+        else {
+            return static_cast<size_t>(hashBytes(&key, significant));
+        }
+    }
+};
+
+// Transparent: std::string, std::string_view and C strings hash the same
+template <>
+struct TableHash<std::string_view> {
+    typedef void is_transparent;
+    size_t operator()(std::string_view key) const {
+        return static_cast<size_t>(hashBytes(key.data(), key.size()));
+    }
+};
+
+template <>
+struct TableHash<std::string> : TableHash<std::string_view> {};
+
+template <typename T>
+struct TableHash<std::vector<T>> {
+    size_t operator()(const std::vector<T>& key) const {
+        uint64_t h = key.size();
+        TableHash<T> element;
+        for (size_t i = 0; i < key.size(); i++) {
+            h = hashMum(h ^ element(key[i]), 0xe7037ed1a0b428dbull);
+        }
+        return static_cast<size_t>(h);
+    }
+};
+
+// Vectors of plain integers are hashed as one byte string
+#define TABLE_HASH_INT_VECTOR(T) \
+template <> \
+struct TableHash<std::vector<T>> { \
+    size_t operator()(const std::vector<T>& key) const { \
+        return static_cast<size_t>(hashBytes(key.data(), key.size() * sizeof(T))); \
+    } \
+};
+TABLE_HASH_INT_VECTOR(char)
+TABLE_HASH_INT_VECTOR(unsigned char)
+TABLE_HASH_INT_VECTOR(short)
+TABLE_HASH_INT_VECTOR(unsigned short)
+TABLE_HASH_INT_VECTOR(int)
+TABLE_HASH_INT_VECTOR(unsigned int)
+TABLE_HASH_INT_VECTOR(long)
+TABLE_HASH_INT_VECTOR(unsigned long)
+TABLE_HASH_INT_VECTOR(long long)
+TABLE_HASH_INT_VECTOR(unsigned long long)
+#undef TABLE_HASH_INT_VECTOR
+
+// A fresh seed for every SeededHash: one random value per process, mixed with
+// a counter
+inline uint64_t hashNextSeed() {
+    static const uint64_t base = (static_cast<uint64_t>(std::random_device()()) << 32) ^ std::random_device()();
+    static std::atomic<uint64_t> counter(0);
+    return hashMix(base ^ (counter.fetch_add(1, std::memory_order_relaxed) * 0x9E3779B97F4A7C15ull));
+}
+
+// Hash policy with a random seed of its own, so that every table hashes
+// differently and keys chosen to share buckets in one table do not share them
+// in another. The seed is mixed into the wrapped hash's result, so keys that
+// hash equal under Hash still hash equal here; only the byte string
+// specializations below, which seed hashBytes itself, break such collisions.
+// A copy keeps the seed.
+template <typename T, typename Hash = TableHash<T>>
+struct SeededHash {
+    uint64_t seed;
+    Hash hasher;
+
+    SeededHash() : seed(hashNextSeed()) {}
+    explicit SeededHash(uint64_t s, const Hash& hash = Hash()) : seed(s), hasher(hash) {}
+    size_t operator()(const T& key) const {
+        return static_cast<size_t>(hashMix(hasher(key) ^ seed));
+    }
+};
+
+// Byte strings take the seed into hashBytes itself
+template <>
+struct SeededHash<std::string_view> {
+    typedef void is_transparent;
+    uint64_t seed;
+
+    SeededHash() : seed(hashNextSeed()) {}
+    explicit SeededHash(uint64_t s) : seed(s) {}
+    size_t operator()(std::string_view key) const {
+        return static_cast<size_t>(hashBytes(key.data(), key.size(), seed));
+    }
+};
+
+template <>
+struct SeededHash<std::string> : SeededHash<std::string_view> {
+    using SeededHash<std::string_view>::SeededHash;
+};
+
+template <typename T>
+struct TableKeyEqual : std::equal_to<T> {};
+
+template <>
+struct TableKeyEqual<std::string> : std::equal_to<> {};
+
+template <>
+struct TableKeyEqual<std::string_view> : std::equal_to<> {};
+
+// HashTable accepts lookup keys of other types when both policies say so
+template <typename Hash, typename KeyEqual, typename = void>
+struct TransparentPolicies : std::false_type {};
+
+template <typename Hash, typename KeyEqual>
+struct TransparentPolicies<Hash, KeyEqual, std::void_t<typename Hash::is_transparent, typename KeyEqual::is_transparent>> : std::true_type {};
+
+// Whether the chained HashTable stores the full hash next to every entry.
+// Arithmetic keys hash and compare in a few instructions, so caching only
+// costs memory for them; anything else (strings, vectors) keeps the hash.
+// Specialize it to override the choice for a key type or a hash policy.
+template <typename KeyType, typename Hash>
+struct CacheHashCode : std::integral_constant<bool,
+    !std::is_arithmetic<KeyType>::value && !std::is_enum<KeyType>::value> {};
+
+// SortTable and the trees compare keys with operators directly; K may be used
+// for lookups in a table keyed by KeyType when this is true. Specialize it for
+// other key types that compare with each other.
+template <typename KeyType, typename K>
+struct TransparentKey : std::integral_constant<bool,
+    std::is_same<KeyType, std::string>::value &&
+    !std::is_same<typename std::decay<K>::type, std::string>::value &&
+    std::is_convertible<const K&, std::string_view>::value> {};
@@ -1,12 +1,14 @@
 #pragma once
+#include <cstddef>
 #include <vector>
 #include <algorithm>
 #include <chrono>
+#include <utility>
 
 template<typename KeyType, typename ValueType>
 class BaseTable;
 
-template<typename KeyType, typename ValueType>
+template<typename KeyType, typename ValueType, size_t InlineCapacity = 0>
 class SimpleTable;
 
 template<typename KeyType, typename ValueType>
@@ -17,7 +19,7 @@ template<typename KeyType, typename ValueType>
 class Iterator : public std::iterator<std::input_iterator_tag, ValueType>
 {
     friend class BaseTable<KeyType, ValueType>;
-    friend class SimpleTable<KeyType, ValueType>;
+    template<typename, typename, size_t> friend class SimpleTable;
     friend class SortTable<KeyType, ValueType>;
 private:
     Iterator() {}
@@ -63,7 +65,9 @@ public:
     Node* right;
     Node* parent;
 
-    Node(KeyType key, ValueType value) : key{ key }, value{ value }, left{ nullptr }, right{ nullptr }, parent { nullptr } {}
+    Node(KeyType key, ValueType value) : key{ std::move(key) }, value{ std::move(value) }, left{ nullptr }, right{ nullptr }, parent { nullptr } {}
+    template <typename K, typename... Args>
+    Node(std::piecewise_construct_t, K&& key, Args&&... args) : key(std::forward<K>(key)), value(std::forward<Args>(args)...), left{ nullptr }, right{ nullptr }, parent{ nullptr } {}
 
 };
 
@@ -122,7 +126,9 @@ public:
     NodeAVL* parent;
     int height; // ����� ���� ��� AVL ������
 
-    NodeAVL(KeyType key, ValueType value) : key{ key }, value{ value }, left{ nullptr }, right{ nullptr }, parent{ nullptr }, height{ 1 } {}
+    NodeAVL(KeyType key, ValueType value) : key{ std::move(key) }, value{ std::move(value) }, left{ nullptr }, right{ nullptr }, parent{ nullptr }, height{ 1 } {}
+    template <typename K, typename... Args>
+    NodeAVL(std::piecewise_construct_t, K&& key, Args&&... args) : key(std::forward<K>(key)), value(std::forward<Args>(args)...), left{ nullptr }, right{ nullptr }, parent{ nullptr }, height{ 1 } {}
 };
 
 template <typename KeyType, typename ValueType>
@@ -181,7 +187,10 @@ public:
     bool is_red;
 
     NodeRB(KeyType key, ValueType value, bool is_red = true)
-        : key{ key }, value{ value }, left{ nullptr }, right{ nullptr }, parent{ nullptr }, is_red{ is_red } {}
+        : key{ std::move(key) }, value{ std::move(value) }, left{ nullptr }, right{ nullptr }, parent{ nullptr }, is_red{ is_red } {}
+    template <typename K, typename... Args>
+    NodeRB(std::piecewise_construct_t, K&& key, Args&&... args)
+        : key(std::forward<K>(key)), value(std::forward<Args>(args)...), left{ nullptr }, right{ nullptr }, parent{ nullptr }, is_red{ true } {}
 };
 
 template <typename KeyType, typename ValueType>
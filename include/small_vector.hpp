@@ -0,0 +1,181 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+// std::vector-like sequence that keeps up to N elements inside the object and
+// only moves them to the heap once it outgrows that. Has what the tables use.
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(N > 0, "use std::vector for no inline elements");
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    SmallVector() : ptr(inlineData()), count(0), cap(N) {}
+    SmallVector(const SmallVector& other) : SmallVector() {
+        reserve(other.count);
+        for (; count < other.count; count++) {
+            new (ptr + count) T(other.ptr[count]);
+        }
+    }
+    SmallVector(SmallVector&& other) : SmallVector() {
+        take(other);
+    }
+    SmallVector& operator=(const SmallVector& other) {
+        if (this != &other) {
+            SmallVector copy(other);
+            clear();
+            take(copy);
+        }
+        return *this;
+    }
+    SmallVector& operator=(SmallVector&& other) {
+        if (this != &other) {
+            clear();
+            take(other);
+        }
+        return *this;
+    }
+    ~SmallVector() {
+        clear();
+        release();
+    }
+    size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+    size_t capacity() const {
+        return cap;
+    }
+    // Whether the elements live inside the object
+    bool isInline() const {
+        return ptr == inlineData();
+    }
+    T* data() {
+        return ptr;
+    }
+    iterator begin() {
+        return ptr;
+    }
+    iterator end() {
+        return ptr + count;
+    }
+    const_iterator begin() const {
+        return ptr;
+    }
+    const_iterator end() const {
+        return ptr + count;
+    }
+    T& operator[](size_t i) {
+        return ptr[i];
+    }
+    const T& operator[](size_t i) const {
+        return ptr[i];
+    }
+    T& front() {
+        return ptr[0];
+    }
+    T& back() {
+        return ptr[count - 1];
+    }
+    void reserve(size_t n) {
+        if (n > cap) {
+            moveTo(n);
+        }
+    }
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (count == cap) {
+            // built first: args may refer to an element that moves
+            T value(std::forward<Args>(args)...);
+            moveTo(cap * 2);
+            new (ptr + count) T(std::move(value));
+        }
+        else {
+            new (ptr + count) T(std::forward<Args>(args)...);
+        }
+        return ptr[count++];
+    }
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
+    }
+    template <typename... Args>
+    iterator emplace(const_iterator pos, Args&&... args) {
+        size_t i = pos - ptr;
+        emplace_back(std::forward<Args>(args)...);
+        std::rotate(ptr + i, ptr + count - 1, ptr + count);
+        return ptr + i;
+    }
+    iterator insert(const_iterator pos, T&& value) {
+        return emplace(pos, std::move(value));
+    }
+    iterator erase(const_iterator pos) {
+        size_t i = pos - ptr;
+        std::move(ptr + i + 1, ptr + count, ptr + i);
+        ptr[--count].~T();
+        return ptr + i;
+    }
+    void clear() {
+        for (size_t i = 0; i < count; i++) {
+            ptr[i].~T();
+        }
+        count = 0;
+    }
+private:
+    alignas(T) unsigned char storage[N * sizeof(T)];
+    T* ptr;
+    size_t count;
+    size_t cap;
+
+    T* inlineData() {
+        return reinterpret_cast<T*>(storage);
+    }
+    const T* inlineData() const {
+        return reinterpret_cast<const T*>(storage);
+    }
+    void moveTo(size_t n) {
+        T* p = std::allocator<T>().allocate(n);
+        for (size_t i = 0; i < count; i++) {
+            new (p + i) T(std::move(ptr[i]));
+            ptr[i].~T();
+        }
+        release();
+        ptr = p;
+        cap = n;
+    }
+    void release() {
+        if (!isInline()) {
+            std::allocator<T>().deallocate(ptr, cap);
+        }
+        ptr = inlineData();
+        cap = N;
+    }
+    // Moves the elements of an other, empty, vector here; steals its heap
+    // block if it has one
+    void take(SmallVector& other) {
+        if (!other.isInline()) {
+            release();
+            ptr = other.ptr;
+            cap = other.cap;
+            count = other.count;
+            other.ptr = other.inlineData();
+            other.cap = N;
+            other.count = 0;
+            return;
+        }
+        reserve(other.count);
+        for (size_t i = 0; i < other.count; i++) {
+            new (ptr + count++) T(std::move(other.ptr[i]));
+        }
+        other.clear();
+    }
+};
@@ -0,0 +1,256 @@
+#pragma once
+#include "table.hpp"
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Append-only store for the bytes of string keys. Strings are copied into
+// large chunks and never move or get freed before the arena itself, so keys
+// can point at them directly. Thread safe; intern() keeps equal strings once.
+class StringArena {
+public:
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    StringArena() : cursor(nullptr), left(0), reserved_(0), interned(0) {}
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+    ~StringArena() {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            delete[] chunks[i];
+        }
+    }
+    // The process-wide arena that ArenaString uses by default
+    static StringArena& shared() {
+        static StringArena arena;
+        return arena;
+    }
+    // Copies the bytes in
+    const char* store(std::string_view s) {
+        std::lock_guard<std::mutex> guard(lock);
+        return append(s);
+    }
+    // Like store(), but a string equal to one interned before gets the same
+    // bytes back instead of a new copy
+    const char* intern(std::string_view s) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = interned.find(s);
+        if (it != interned.end()) {
+            return it->second;
+        }
+        const char* p = append(s);
+        interned.try_emplace(std::string_view(p, s.size()), p);
+        return p;
+    }
+    // Bytes taken from operator new
+    size_t reserved() const {
+        return reserved_;
+    }
+private:
+    std::vector<char*> chunks;
+    char* cursor;
+    size_t left; // bytes after cursor in the last chunk
+    size_t reserved_;
+    HashTable<std::string_view, const char*> interned;
+    std::mutex lock;
+
+    const char* append(std::string_view s) {
+        if (s.empty()) {
+            return "";
+        }
+        if (s.size() > left) {
+            // the tail of the current chunk is given up
+            size_t size = std::max(chunkSize, s.size());
+            chunks.push_back(new char[size]);
+            cursor = chunks.back();
+            left = size;
+            reserved_ += size;
+        }
+        char* p = cursor;
+        std::memcpy(p, s.data(), s.size());
+        cursor += s.size();
+        left -= s.size();
+        return p;
+    }
+};
+
+// String key whose bytes live in a StringArena: a pointer to them, the length
+// and the first bytes inline, 16 bytes in all against 32 for std::string plus
+// its heap block. Most comparisons are settled by the length and the inline
+// prefix without reading the arena; interned keys are equal when their
+// pointers are.
+//
+// Building one from a string copies it into an arena, the shared one by
+// default, which only grows; so the constructors are explicit and a plain
+// string never turns into a key by itself. Lookups pass the string itself
+// where the table takes it (HashTable, and SortTable through TransparentKey)
+// or a borrowed() key elsewhere. The arena must outlive its keys. Keys are
+// shorter than 4 GiB; a longer string throws.
+class ArenaString {
+public:
+    static constexpr size_t prefixSize = 4;
+
+    ArenaString() : ArenaString(std::string_view()) {}
+    explicit ArenaString(std::string_view s, StringArena& arena = StringArena::shared()) : ArenaString(arena.store(checked(s)), s.size()) {}
+    explicit ArenaString(const std::string& s) : ArenaString(std::string_view(s)) {}
+    explicit ArenaString(const char* s) : ArenaString(std::string_view(s)) {}
+    // A copy of s that shares its bytes with every equal interned string
+    static ArenaString interned(std::string_view s, StringArena& arena = StringArena::shared()) {
+        return ArenaString(arena.intern(checked(s)), s.size());
+    }
+    // Lookup key over the caller's bytes, valid while they are; nothing is
+    // copied
+    static ArenaString borrowed(std::string_view s) {
+        return ArenaString(checked(s).data(), s.size());
+    }
+    const char* data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    std::string_view view() const {
+        return std::string_view(data_, size_);
+    }
+    std::string str() const {
+        return std::string(data_, size_);
+    }
+    // Same sign as view().compare(), usually decided by the prefixes
+    int compare(const ArenaString& other) const {
+        int c = std::memcmp(prefix, other.prefix, prefixSize);
+        if (c != 0 || (size_ <= prefixSize && other.size_ <= prefixSize)) {
+            return c != 0 ? c : static_cast<int>(size_) - static_cast<int>(other.size_);
+        }
+        return view().compare(other.view());
+    }
+    int compare(std::string_view other) const {
+        return view().compare(other);
+    }
+    friend bool operator==(const ArenaString& a, const ArenaString& b) {
+        return a.size_ == b.size_ && std::memcmp(a.prefix, b.prefix, prefixSize) == 0 &&
+               (a.data_ == b.data_ || a.size_ <= prefixSize || std::memcmp(a.data_, b.data_, a.size_) == 0);
+    }
+    friend bool operator!=(const ArenaString& a, const ArenaString& b) {
+        return !(a == b);
+    }
+    friend bool operator<(const ArenaString& a, const ArenaString& b) {
+        return a.compare(b) < 0;
+    }
+    friend bool operator>(const ArenaString& a, const ArenaString& b) {
+        return a.compare(b) > 0;
+    }
+    friend bool operator<=(const ArenaString& a, const ArenaString& b) {
+        return a.compare(b) <= 0;
+    }
+    friend bool operator>=(const ArenaString& a, const ArenaString& b) {
+        return a.compare(b) >= 0;
+    }
+    friend std::ostream& operator<<(std::ostream& out, const ArenaString& s) {
+        return out << s.view();
+    }
+private:
+    const char* data_;
+    uint32_t size_;
+    char prefix[prefixSize]; // zero padded
+
+    // The length has to fit size_
+    static std::string_view checked(std::string_view s) {
+        if (s.size() > UINT32_MAX) {
+            throw std::runtime_error("Invalid key length!");
+        }
+        return s;
+    }
+    ArenaString(const char* data, size_t size) : data_(data), size_(static_cast<uint32_t>(size)), prefix() {
+        if (size != 0) {
+            std::memcpy(prefix, data, std::min(size, prefixSize));
+        }
+    }
+};
+
+// Comparisons with plain strings, which take these exact matches rather than
+// a conversion to ArenaString (and a copy into the arena)
+template <typename S>
+using IfPlainString = typename std::enable_if<!std::is_same<typename std::decay<S>::type, ArenaString>::value &&
+                                              std::is_convertible<const S&, std::string_view>::value, bool>::type;
+
+template <typename S>
+IfPlainString<S> operator==(const ArenaString& a, const S& b) {
+    return a.view() == std::string_view(b);
+}
+template <typename S>
+IfPlainString<S> operator==(const S& a, const ArenaString& b) {
+    return b == a;
+}
+template <typename S>
+IfPlainString<S> operator!=(const ArenaString& a, const S& b) {
+    return !(a == b);
+}
+template <typename S>
+IfPlainString<S> operator!=(const S& a, const ArenaString& b) {
+    return !(b == a);
+}
+template <typename S>
+IfPlainString<S> operator<(const ArenaString& a, const S& b) {
+    return a.compare(std::string_view(b)) < 0;
+}
+template <typename S>
+IfPlainString<S> operator<(const S& a, const ArenaString& b) {
+    return b.compare(std::string_view(a)) > 0;
+}
+template <typename S>
+IfPlainString<S> operator>(const ArenaString& a, const S& b) {
+    return a.compare(std::string_view(b)) > 0;
+}
+template <typename S>
+IfPlainString<S> operator>(const S& a, const ArenaString& b) {
+    return b.compare(std::string_view(a)) < 0;
+}
+template <typename S>
+IfPlainString<S> operator<=(const ArenaString& a, const S& b) {
+    return a.compare(std::string_view(b)) <= 0;
+}
+template <typename S>
+IfPlainString<S> operator<=(const S& a, const ArenaString& b) {
+    return b.compare(std::string_view(a)) >= 0;
+}
+template <typename S>
+IfPlainString<S> operator>=(const ArenaString& a, const S& b) {
+    return a.compare(std::string_view(b)) >= 0;
+}
+template <typename S>
+IfPlainString<S> operator>=(const S& a, const ArenaString& b) {
+    return b.compare(std::string_view(a)) <= 0;
+}
+
+// Transparent: ArenaString hashes like the plain string it holds
+template <>
+struct TableHash<ArenaString> {
+    typedef void is_transparent;
+    size_t operator()(const ArenaString& key) const {
+        return static_cast<size_t>(hashBytes(key.data(), key.size()));
+    }
+    template <typename S, typename = IfPlainString<S>>
+    size_t operator()(const S& key) const {
+        std::string_view view(key);
+        return static_cast<size_t>(hashBytes(view.data(), view.size()));
+    }
+};
+
+template <>
+struct TableKeyEqual<ArenaString> {
+    typedef void is_transparent;
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const {
+        return a == b;
+    }
+};
+
+template <typename K>
+struct TransparentKey<ArenaString, K> : std::integral_constant<bool,
+    !std::is_same<typename std::decay<K>::type, ArenaString>::value &&
+    std::is_convertible<const K&, std::string_view>::value> {};
@@ -1,6 +1,27 @@
 #pragma once
 #include "iterator.hpp"
+#include "hash.hpp"
+#include "small_vector.hpp"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(TABLE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TABLE_SSE2
+#include <emmintrin.h>
+#endif
 
 template<typename KeyType, typename ValueType>
 class BaseTable
@@ -30,10 +51,15 @@ public:
     virtual Iterator<KeyType, ValueType> getMax() { return end(); }
 };
 
-template<typename KeyType, typename ValueType>
+// Entry storage of SimpleTable: a plain vector, or with InlineCapacity > 0 a
+// SmallVector that holds that many entries without touching the heap
+template<typename Entry, size_t InlineCapacity>
+using SimpleStorage = typename std::conditional<InlineCapacity == 0, std::vector<Entry>, SmallVector<Entry, InlineCapacity> >::type;
+
+template<typename KeyType, typename ValueType, size_t InlineCapacity>
 class SimpleTable : public BaseTable<KeyType, ValueType>
 {
-    std::vector<std::pair<KeyType, ValueType> > keyData;
+    SimpleStorage<std::pair<KeyType, ValueType>, InlineCapacity> keyData;
 public:
     virtual Iterator<KeyType, ValueType> begin() override
     {
@@ -58,9 +84,41 @@ public:
     }
     Iterator<KeyType, ValueType> insert(const KeyType& key, const ValueType& value) override
     {
-        keyData.push_back(std::make_pair(key, value));
+        keyData.emplace_back(key, value);
         return Iterator<KeyType, ValueType>(&keyData.back() - 1ull);
     }
+    template <typename... Args>
+    Iterator<KeyType, ValueType> emplace(Args&&... args)
+    {
+        keyData.emplace_back(std::forward<Args>(args)...);
+        return Iterator<KeyType, ValueType>(&keyData.back());
+    }
+    template <typename... Args>
+    std::pair<Iterator<KeyType, ValueType>, bool> try_emplace(const KeyType& key, Args&&... args)
+    {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<Iterator<KeyType, ValueType>, bool> try_emplace(KeyType&& key, Args&&... args)
+    {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+    template <typename M>
+    std::pair<Iterator<KeyType, ValueType>, bool> insert_or_assign(const KeyType& key, M&& obj)
+    {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second)
+            result.first.getPtr()->second = std::forward<M>(obj);
+        return result;
+    }
+    template <typename M>
+    std::pair<Iterator<KeyType, ValueType>, bool> insert_or_assign(KeyType&& key, M&& obj)
+    {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second)
+            result.first.getPtr()->second = std::forward<M>(obj);
+        return result;
+    }
     virtual void remove(const KeyType& key) override
     {
         Iterator<KeyType, ValueType> iter(find(key));
@@ -101,6 +159,19 @@ public:
         }
         return max;
     }
+private:
+    // The key is only moved from when it is actually inserted
+    template <typename K, typename... Args>
+    std::pair<Iterator<KeyType, ValueType>, bool> tryEmplaceKey(K&& key, Args&&... args)
+    {
+        for (size_t i = 0; i < keyData.size(); i++)
+        {
+            if (keyData[i].first == key)
+                return std::make_pair(Iterator<KeyType, ValueType>(&keyData[i]), false);
+        }
+        keyData.emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::make_pair(Iterator<KeyType, ValueType>(&keyData.back()), true);
+    }
 };
 
 template<typename KeyType, typename ValueType>
@@ -122,19 +193,12 @@ public:
     }
     Iterator<KeyType, ValueType> find(const KeyType& key) override
     {
-        size_t left = 0, right = keyData.size();
-        while (left + 1 < right) {
-            int med = (left + right) / 2;
-            if (keyData[med].first <= key)
-                left = med;
-            else
-                right = med;
-        }
-        if (left < keyData.size() && keyData[left].first == key)
-            return Iterator<KeyType, ValueType>(&keyData[0] + left);
-        else
-            return Iterator<KeyType, ValueType>(&keyData[0] + keyData.size());
-
+        return findKey(key);
+    }
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    Iterator<KeyType, ValueType> find(const K& key)
+    {
+        return findKey(key);
     }
     Iterator<KeyType, ValueType> insert(const KeyType& key, const ValueType& value) override
     {
@@ -148,65 +212,545 @@ public:
                 left = med + 1;
         }
 
-        auto pair = std::make_pair(key, value);
         if (left == keyData.size())
         {
-            keyData.push_back(pair);
+            keyData.emplace_back(key, value);
             return Iterator<KeyType, ValueType>(&keyData.back() - 1);
         }
 
         auto it = keyData.begin();
         std::advance(it, left);
-        keyData.insert(it, pair);
+        keyData.emplace(it, key, value);
         return Iterator<KeyType, ValueType>(&keyData[left] - 1);
-
+    }
+    template <typename... Args>
+    Iterator<KeyType, ValueType> emplace(Args&&... args)
+    {
+        std::pair<KeyType, ValueType> pair(std::forward<Args>(args)...);
+        size_t left = 0, right = keyData.size();
+        while (left < right)
+        {
+            size_t med = (right - left) / 2 + left;
+            if (pair.first < keyData[med].first)
+                right = med;
+            else
+                left = med + 1;
+        }
+        keyData.insert(keyData.begin() + left, std::move(pair));
+        return Iterator<KeyType, ValueType>(&keyData[left]);
+    }
+    template <typename... Args>
+    std::pair<Iterator<KeyType, ValueType>, bool> try_emplace(const KeyType& key, Args&&... args)
+    {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<Iterator<KeyType, ValueType>, bool> try_emplace(KeyType&& key, Args&&... args)
+    {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+    template <typename M>
+    std::pair<Iterator<KeyType, ValueType>, bool> insert_or_assign(const KeyType& key, M&& obj)
+    {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second)
+            result.first.getPtr()->second = std::forward<M>(obj);
+        return result;
+    }
+    template <typename M>
+    std::pair<Iterator<KeyType, ValueType>, bool> insert_or_assign(KeyType&& key, M&& obj)
+    {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second)
+            result.first.getPtr()->second = std::forward<M>(obj);
+        return result;
     }
     virtual void remove(const KeyType& key) override
     {
-        Iterator<KeyType, ValueType> it = find(key);
-        keyData.erase(std::remove(keyData.begin(), keyData.end(), *it.getPtr()));
+        removeKey(key);
+    }
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    void remove(const K& key)
+    {
+        removeKey(key);
     }
     virtual ValueType& operator[](const KeyType& key) override
     {
-        return *(find(key));
+        return *(findKey(key));
+    }
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    ValueType& operator[](const K& key)
+    {
+        return *(findKey(key));
+    }
+private:
+    template <typename K>
+    Iterator<KeyType, ValueType> findKey(const K& key)
+    {
+        size_t left = 0, right = keyData.size();
+        while (left + 1 < right) {
+            int med = (left + right) / 2;
+            if (keyData[med].first <= key)
+                left = med;
+            else
+                right = med;
+        }
+        if (left < keyData.size() && keyData[left].first == key)
+            return Iterator<KeyType, ValueType>(&keyData[0] + left);
+        else
+            return Iterator<KeyType, ValueType>(&keyData[0] + keyData.size());
+
+    }
+    template <typename K>
+    void removeKey(const K& key)
+    {
+        Iterator<KeyType, ValueType> it = findKey(key);
+        if (it.getPtr() != &keyData[0] + keyData.size())
+            keyData.erase(keyData.begin() + (it.getPtr() - &keyData[0]));
+    }
+    template <typename K, typename... Args>
+    std::pair<Iterator<KeyType, ValueType>, bool> tryEmplaceKey(K&& key, Args&&... args)
+    {
+        size_t left = 0, right = keyData.size();
+        while (left < right)
+        {
+            size_t med = (right - left) / 2 + left;
+            if (keyData[med].first < key)
+                left = med + 1;
+            else
+                right = med;
+        }
+        if (left < keyData.size() && keyData[left].first == key)
+            return std::make_pair(Iterator<KeyType, ValueType>(&keyData[left]), false);
+        keyData.emplace(keyData.begin() + left, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::make_pair(Iterator<KeyType, ValueType>(&keyData[left]), true);
     }
 };
 
-template <typename KeyType, typename ValueType>
-class HashTable {
+// Collision resolution strategies for HashTable
+struct Chaining {};     // separate chain (std::vector) per bucket
+struct StableChaining {}; // Chaining with every entry in a node of its own
+struct RobinHood {};    // flat open addressing, Robin Hood displacement
+struct GroupProbing {}; // Swiss-table style control bytes, SIMD group probing
+struct Cuckoo {};       // two candidate buckets of 4 slots, BFS eviction
+struct Flat {};         // integral keys only: dense key array, linear probing
+
+// Asks the CPU to start loading the cache line at p; never faults
+inline void tablePrefetch(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#elif defined(TABLE_SSE2)
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#endif
+}
+
+// How many keys find_batch and contains_batch hash and prefetch ahead
+constexpr size_t tableBatchWidth = 16;
+
+// contains_batch of every HashTable engine, on top of its find_batch
+template <typename Table, typename Key>
+size_t containsBatch(Table& table, const Key* keys, size_t n, bool* out) {
+    std::vector<typename Table::HashIterator> found(std::min(n, tableBatchWidth), table.end());
+    size_t count = 0;
+    for (size_t first = 0; first < n; first += tableBatchWidth) {
+        size_t m = std::min(tableBatchWidth, n - first);
+        table.find_batch(keys + first, m, found.data());
+        for (size_t i = 0; i < m; i++) {
+            out[first + i] = found[i] != table.end();
+            count += out[first + i];
+        }
+    }
+    return count;
+}
+
+// An entry of a hash chain. With Cached it also keeps the full hash of its key,
+// so that rehashing never calls the hasher and chain scans only compare keys
+// whose hashes are equal.
+template <typename Entry, bool Cached>
+struct ChainEntry {
+    Entry entry;
+    size_t hash;
+    template <typename... Args>
+    ChainEntry(size_t h, Args&&... args) : entry(std::forward<Args>(args)...), hash(h) {}
+};
+
+template <typename Entry>
+struct ChainEntry<Entry, false> {
+    Entry entry;
+    template <typename... Args>
+    ChainEntry(size_t, Args&&... args) : entry(std::forward<Args>(args)...) {}
+};
+
+// Snapshot of a HashTable's layout, returned by stats(). The table is scanned
+// when stats() is called, so gathering one costs O(bucket_count()) then and
+// nothing in between.
+struct TableStats {
+    size_t size = 0;
+    size_t buckets = 0;         // bucket_count(): buckets, or slots
+    float loadFactor = 0;
+    float emptyBucketRatio = 0; // share of bucket_count() that is empty
+    // probeLengths[k]: entries that a lookup reaches with k + 1 probes - the
+    // position in the chain, or the slots (groups, buckets) walked from home
+    std::vector<size_t> probeLengths;
+    // Only counted with TABLE_STATS defined, otherwise 0
+    size_t rehashCount = 0;
+    double rehashSeconds = 0;
+    double maxRehashSeconds = 0;
+    size_t bytes = 0; // the table's own arrays, not what keys and values own
+
+    void countProbe(size_t probes) {
+        if (probeLengths.size() < probes) {
+            probeLengths.resize(probes, 0);
+        }
+        probeLengths[probes - 1]++;
+    }
+    double meanProbeLength() const {
+        size_t total = 0;
+        for (size_t k = 0; k < probeLengths.size(); k++) {
+            total += probeLengths[k] * (k + 1);
+        }
+        return size != 0 ? static_cast<double>(total) / size : 0;
+    }
+    double bytesPerEntry() const {
+        return size != 0 ? static_cast<double>(bytes) / size : 0;
+    }
+    friend std::ostream& operator<<(std::ostream& out, const TableStats& stats) {
+        out << "size: " << stats.size << " buckets: " << stats.buckets << " load factor: " << stats.loadFactor
+            << " empty buckets: " << stats.emptyBucketRatio << std::endl;
+        out << "probe lengths:";
+        for (size_t k = 0; k < stats.probeLengths.size(); k++) {
+            out << " " << k + 1 << ": " << stats.probeLengths[k];
+        }
+        out << " (mean " << stats.meanProbeLength() << ")" << std::endl;
+        out << "rehashes: " << stats.rehashCount << " total: " << stats.rehashSeconds << " s max: " << stats.maxRehashSeconds << " s" << std::endl;
+        out << "bytes: " << stats.bytes << " per entry: " << stats.bytesPerEntry() << std::endl;
+        return out;
+    }
+};
+
+// Rehash counters of every HashTable engine, which derives from it. With
+// TABLE_STATS defined a rehash costs two clock reads more; without it the
+// class is empty and every call compiles to nothing.
+#ifdef TABLE_STATS
+class RehashLog {
+public:
+    class Timer {
+    private:
+        RehashLog& log;
+        std::chrono::steady_clock::time_point start;
+    public:
+        explicit Timer(RehashLog& rehashLog) : log(rehashLog), start(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            log.total += seconds;
+            log.current += seconds;
+            log.longest = std::max(log.longest, log.current);
+        }
+    };
+    RehashLog() : count(0), total(0), current(0), longest(0) {}
+    // A copy starts its own history
+    RehashLog(const RehashLog&) : RehashLog() {}
+    RehashLog& operator=(const RehashLog&) {
+        return *this;
+    }
+protected:
+    // Counts a new rehash; its time is what the Timers of it add up to
+    void rehashStarted() {
+        count++;
+        current = 0;
+    }
+    Timer rehashTimer() {
+        return Timer(*this);
+    }
+    void fillRehashStats(TableStats& stats) const {
+        stats.rehashCount = count;
+        stats.rehashSeconds = total;
+        stats.maxRehashSeconds = longest;
+    }
+private:
+    size_t count;
+    double total;
+    double current; // of the last rehash, which may still be in progress
+    double longest;
+};
+#else
+class RehashLog {
+public:
+    struct Timer {
+        ~Timer() {}
+    };
+protected:
+    void rehashStarted() {}
+    Timer rehashTimer() {
+        return Timer();
+    }
+    void fillRehashStats(TableStats&) const {}
+};
+#endif
+
+// Memory behind the chains of one chained HashTable. Blocks of power of two
+// sizes are cut from large chunks, and a block a chain lets go of goes on the
+// free list of its size, so growing chains and rehashes that move entries
+// between them reuse blocks instead of calling malloc. The chunks are freed
+// with the arena. It is not thread safe, apart from Regions.
+class ChainArena {
+public:
+    static constexpr size_t minBlock = 16; // also the alignment of every block
+    static constexpr size_t maxBlock = 4096; // larger ones use operator new
+
+    // Lets several threads allocate from one arena at once (the workers of a
+    // parallel rehash). A thread reserves up front, in one chunk, all the
+    // blocks it will need; while its Region lives, its allocations from the
+    // arena are cut from that chunk and never touch the shared state.
+    class Region {
+    public:
+        Region(ChainArena& arena, size_t bytes) : owner(arena), cursor(nullptr), left(bytes), previous(active) {
+            if (bytes != 0) {
+                std::lock_guard<std::mutex> lock(owner.regionLock);
+                owner.chunks.push_back(::operator new(bytes, std::align_val_t(minBlock)));
+                cursor = static_cast<char*>(owner.chunks.back());
+                owner.reserved_ += bytes;
+            }
+            active = this;
+        }
+        Region(const Region&) = delete;
+        Region& operator=(const Region&) = delete;
+        ~Region() {
+            active = previous;
+        }
+    private:
+        friend class ChainArena;
+        ChainArena& owner;
+        char* cursor;
+        size_t left;
+        Region* previous;
+    };
+
+    ChainArena() : cursor(nullptr), left(0), nextChunk(4096), reserved_(0), freeLists() {}
+    ChainArena(const ChainArena&) = delete;
+    ChainArena& operator=(const ChainArena&) = delete;
+    ~ChainArena() {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            ::operator delete(chunks[i], std::align_val_t(minBlock));
+        }
+    }
+    void* allocate(size_t bytes) {
+        if (bytes > maxBlock) {
+            reserved_ += bytes;
+            return ::operator new(bytes, std::align_val_t(minBlock));
+        }
+        int c = sizeClass(bytes);
+        if (active != nullptr && &active->owner == this && active->left >= (minBlock << c)) {
+            void* p = active->cursor;
+            active->cursor += minBlock << c;
+            active->left -= minBlock << c;
+            return p;
+        }
+        if (freeLists[c] != nullptr) {
+            FreeBlock* block = freeLists[c];
+            freeLists[c] = block->next;
+            return block;
+        }
+        size_t size = minBlock << c;
+        if (left < size) {
+            refill();
+        }
+        void* p = cursor;
+        cursor += size;
+        left -= size;
+        return p;
+    }
+    void deallocate(void* p, size_t bytes) {
+        if (bytes > maxBlock) {
+            reserved_ -= bytes;
+            ::operator delete(p, std::align_val_t(minBlock));
+            return;
+        }
+        push(p, sizeClass(bytes));
+    }
+    // Bytes taken from operator new and not given back yet
+    size_t reserved() const {
+        return reserved_;
+    }
+    // What a Region must hold for a block of the given size; 0 for blocks
+    // that bypass the chunks
+    static size_t blockSize(size_t bytes) {
+        return bytes == 0 || bytes > maxBlock ? 0 : minBlock << sizeClass(bytes);
+    }
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    static constexpr int classes = 9; // minBlock << 8 == maxBlock
+
+    std::vector<void*> chunks;
+    char* cursor;
+    size_t left;      // bytes after cursor in the last chunk
+    size_t nextChunk; // doubles up to 1 MB
+    std::atomic<size_t> reserved_;
+    FreeBlock* freeLists[classes];
+    std::mutex regionLock;
+
+    inline static thread_local Region* active = nullptr;
+
+    static int sizeClass(size_t bytes) {
+        int c = 0;
+        while ((minBlock << c) < bytes) {
+            c++;
+        }
+        return c;
+    }
+    void push(void* p, int c) {
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = freeLists[c];
+        freeLists[c] = block;
+    }
+    // The tail of the current chunk goes to the free lists, largest blocks first
+    void refill() {
+        for (int c = classes - 1; c >= 0; c--) {
+            while (left >= (minBlock << c)) {
+                push(cursor, c);
+                cursor += minBlock << c;
+                left -= minBlock << c;
+            }
+        }
+        chunks.push_back(::operator new(nextChunk, std::align_val_t(minBlock)));
+        cursor = static_cast<char*>(chunks.back());
+        left = nextChunk;
+        reserved_ += nextChunk;
+        nextChunk = std::min(nextChunk * 2, static_cast<size_t>(1) << 20);
+    }
+};
+
+// Allocator of the chains: every chain of a table points at the table's arena
+template <typename T>
+class ArenaAllocator {
+    static_assert(alignof(T) <= ChainArena::minBlock, "entries are over-aligned for ChainArena");
+public:
+    typedef T value_type;
+
+    ChainArena* arena;
+
+    explicit ArenaAllocator(ChainArena* chainArena) : arena(chainArena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        arena->deallocate(p, n * sizeof(T));
+    }
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+};
+
+// Holds the entry of a StableChaining chain in a heap node of its own. Moving
+// it moves the pointer, so the entry keeps its address while its chain grows,
+// gets sorted and the table rehashes; copying it copies the entry.
+template <typename Entry>
+class StableNode {
+public:
+    explicit StableNode(Entry&& entry) : node(new Entry(std::move(entry))) {}
+    template <typename... Args>
+    StableNode(std::piecewise_construct_t, Args&&... args) : node(new Entry(std::piecewise_construct, std::forward<Args>(args)...)) {}
+    StableNode(const StableNode& other) : node(new Entry(*other.node)) {}
+    StableNode(StableNode&&) = default;
+    StableNode& operator=(const StableNode& other) {
+        node.reset(new Entry(*other.node));
+        return *this;
+    }
+    StableNode& operator=(StableNode&&) = default;
+    Entry& get() const {
+        return *node;
+    }
 private:
-    std::vector<std::pair<KeyType, ValueType>>* array;
+    std::unique_ptr<Entry> node;
+};
+
+// Element count of [first, last) when it can be known without consuming the
+// range; single pass input ranges report 0.
+template <typename InputIt>
+size_t rangeLength(InputIt first, InputIt last) {
+    typedef typename std::iterator_traits<InputIt>::iterator_category Category;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+        return static_cast<size_t>(std::distance(first, last));
+    }
+    else {
+        return 0;
+    }
+}
+
+template <typename KeyType, typename ValueType, typename Probing = Chaining,
+          typename Hash = TableHash<KeyType>, typename KeyEqual = TableKeyEqual<KeyType>>
+class HashTable : private RehashLog {
+private:
+    typedef std::pair<KeyType, ValueType> Entry;
+    // StableChaining keeps each entry in a node, so that references to it
+    // stay valid until it is removed, across inserts and rehashes
+    static constexpr bool stable = std::is_same<Probing, StableChaining>::value;
+    typedef ChainEntry<typename std::conditional<stable, StableNode<Entry>, Entry>::type, CacheHashCode<KeyType, Hash>::value> Stored;
+    typedef std::vector<Stored, ArenaAllocator<Stored>> Chain;
+
+    Hash hasher;
+    KeyEqual equal;
+    std::unique_ptr<ChainArena> arena; // storage of every chain
+    Chain* array;
     int length;
+    size_t count;
+    float maxLoadFactor;
+    // While a resize is in flight the previous bucket array stays alive;
+    // buckets [0, migrated) of it are already moved into array.
+    Chain* oldArray;
+    int oldLength;
+    int migrated;
+    int rehashStep;
+    unsigned rehashThreads;
+
+    static constexpr size_t treeifyThreshold = 8;
+    static constexpr size_t parallelRehashMin = 1 << 16; // entries
 public:
     class HashIterator
     {
     private:
-        std::vector<std::pair<KeyType, ValueType>>* array_;
+        Chain* array_;
         size_t counter_;
         size_t number_;
         size_t length_;
-    public:
-        HashIterator(std::vector<std::pair<KeyType, ValueType>>* array, size_t counter, size_t number, size_t length) : array_(array), counter_(counter), number_(number), length_(length) {}
-        HashIterator& operator++()
+        // An iterator into the old buckets of a rehash goes on into the
+        // current array once it runs out of them, and so still reaches end()
+        Chain* next_;
+        size_t nextLength_;
+
+        void skipEmpty()
         {
-            if (array_[counter_].size() == number_ + 1)
-            {
+            while (counter_ < length_ && array_[counter_].size() == 0)
                 counter_++;
-                while (array_[counter_].size() == 0)
-                {
-                    if (counter_ == length_)
-                        return *this;
-                    number_ = 0;
-                    counter_++;
-                }
-            }
-            else
-            {
-                number_++;
+            if (counter_ == length_ && next_ != nullptr) {
+                array_ = next_;
+                length_ = nextLength_;
+                counter_ = 0;
+                next_ = nullptr;
+                skipEmpty();
             }
+        }
+    public:
+        HashIterator(Chain* array, size_t counter, size_t number, size_t length, Chain* next = nullptr, size_t nextLength = 0) : array_(array), counter_(counter), number_(number), length_(length), next_(next), nextLength_(nextLength) {}
+        HashIterator& operator++()
+        {
+            if (++number_ < array_[counter_].size())
+                return *this;
+            number_ = 0;
+            counter_++;
+            skipEmpty();
             return *this;
         }
-        static HashIterator begin(std::vector<std::pair<KeyType, ValueType>>* array, size_t length)
+        static HashIterator begin(Chain* array, size_t length)
         {
             for (size_t i = 0; i < length; i++)
             {
@@ -217,7 +761,7 @@ public:
         }
         std::pair<KeyType, ValueType>& operator*()
         {
-            return array_[counter_][number_];
+            return entryOf(array_[counter_][number_]);
         }
         bool operator ==(const HashIterator& other)
         {
@@ -232,171 +776,2397 @@ public:
             return &**this;
         }
     };
-    HashTable(int ptr) {
+    HashTable(int ptr, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash), equal(keyEqual), arena(new ChainArena()), count(0), maxLoadFactor(1.0f), oldArray(nullptr), oldLength(0), migrated(0), rehashStep(0), rehashThreads(1) {
         if (ptr != 0) {
-            array = new std::vector<std::pair<KeyType, ValueType>>[ptr];
+            array = newChains(ptr);
             length = ptr;
         }
         else {
             ptr++;
-            array = new std::vector<std::pair<KeyType, ValueType>>[ptr];
+            array = newChains(ptr);
             length = ptr;
         }
     }
-    HashTable(const HashTable& table) {
+    // Forward ranges are built in two passes (see build()); single pass
+    // ranges are added with emplace one by one
+    template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashTable(InputIt first, InputIt last, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : HashTable(0, hash, keyEqual) {
+        typedef typename std::iterator_traits<InputIt>::iterator_category Category;
+        if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value) {
+            build(first, last);
+        }
+        else {
+            for (; first != last; ++first) {
+                emplace(*first);
+            }
+        }
+    }
+    HashTable(const HashTable& table) : RehashLog(), hasher(table.hasher), equal(table.equal), arena(new ChainArena()), count(table.count), maxLoadFactor(table.maxLoadFactor), oldArray(nullptr), oldLength(0), migrated(0), rehashStep(table.rehashStep), rehashThreads(table.rehashThreads) {
         length = table.length;
-        array = new std::vector<std::pair<KeyType, ValueType>>[length];
+        array = newChains(length);
         for (int i = 0; i < length; i++) {
             array[i] = table.array[i];
         }
+        if (table.oldArray != nullptr) {
+            oldLength = table.oldLength;
+            migrated = table.migrated;
+            oldArray = newChains(oldLength);
+            for (int i = migrated; i < oldLength; i++) {
+                oldArray[i] = table.oldArray[i];
+            }
+        }
     }
     HashTable& operator=(const HashTable& table) {
         if (this == &table) {
             return *this;
         }
         else {
-            length = table.length;
-            array = new std::vector<std::pair<KeyType, ValueType>>[table.length];
-            for (int i = 0; i < table.length; i++) {
-                array[i] = table.array[i];
-            }
+            HashTable copy(table);
+            std::swap(hasher, copy.hasher);
+            std::swap(equal, copy.equal);
+            std::swap(arena, copy.arena);
+            std::swap(array, copy.array);
+            std::swap(length, copy.length);
+            std::swap(count, copy.count);
+            std::swap(maxLoadFactor, copy.maxLoadFactor);
+            std::swap(oldArray, copy.oldArray);
+            std::swap(oldLength, copy.oldLength);
+            std::swap(migrated, copy.migrated);
+            std::swap(rehashStep, copy.rehashStep);
+            std::swap(rehashThreads, copy.rehashThreads);
         }
         return *this;
     }
     ~HashTable() {
+        deleteChains(array, length);
+        deleteChains(oldArray, oldLength);
         length = 0;
-        delete[] array;
     }
-    int hash(std::string s) {
-        char al[] = "abcdefghijklmnopqrstuvwxyz";
-        int sum = 0;
-        for (int i = 0; i < s.length(); i++) {
-            char c = s[i];
-            for (int j = 0; j < 26; j++) {
-                if (c == al[j]) {
-                    sum += pow(j, i);
+    size_t size() const {
+        return count;
+    }
+    float load_factor() const {
+        return static_cast<float>(count) / length;
+    }
+    float max_load_factor() const {
+        return maxLoadFactor;
+    }
+    // The table doubles its bucket count once size() exceeds this share of it.
+    void max_load_factor(float factor) {
+        if (!(factor > 0.0f)) {
+            throw std::runtime_error("Invalid load factor!");
+        }
+        maxLoadFactor = factor;
+    }
+    // Number of old buckets moved to the new array by every insert, find and
+    // remove while the table grows; 0 moves them all at once.
+    void setRehashStep(int buckets) {
+        rehashStep = buckets > 0 ? buckets : 0;
+    }
+    // Threads that move the entries when the table rehashes at once
+    // (rehashStep 0) with at least 65536 entries; 0 - one per core. Each
+    // takes a share of the old buckets, then fills a share of the new ones.
+    void setRehashThreads(unsigned threads) {
+        rehashThreads = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    }
+    bool isRehashing() const {
+        return oldArray != nullptr;
+    }
+    // Moves every bucket that is still waiting in the old array.
+    void completeRehash() {
+        migrate(oldLength);
+    }
+    size_t bucket_count() const {
+        return length;
+    }
+    // Rebuilds the table at once with at least the given number of buckets,
+    // and never fewer than max_load_factor() needs for the current size.
+    void rehash(size_t buckets) {
+        int newLength = static_cast<int>(std::max(buckets, bucketsFor(count)));
+        completeRehash();
+        startRehash(newLength);
+        completeRehash();
+    }
+    // Makes room for n elements, so that inserting up to n does not resize
+    void reserve(size_t n) {
+        if (bucketsFor(n) > static_cast<size_t>(length)) {
+            rehash(bucketsFor(n));
+        }
+    }
+    void shrink_to_fit() {
+        rehash(0);
+    }
+    // Copies of the hash and equality policies
+    Hash hash_function() const {
+        return hasher;
+    }
+    KeyEqual key_eq() const {
+        return equal;
+    }
+    // Layout snapshot: probe lengths, empty buckets, memory and, with
+    // TABLE_STATS, rehash counts and times. Scans the whole table.
+    TableStats stats() const {
+        TableStats stats;
+        stats.size = count;
+        stats.buckets = bucket_count();
+        stats.loadFactor = load_factor();
+        size_t empty = 0;
+        for (int i = 0; i < length; i++) {
+            chainStats(array[i], stats);
+            empty += array[i].empty();
+        }
+        for (int i = migrated; i < oldLength; i++) {
+            chainStats(oldArray[i], stats);
+        }
+        stats.bytes = (length + oldLength) * sizeof(Chain) + arena->reserved();
+        stats.emptyBucketRatio = static_cast<float>(empty) / length;
+        fillRehashStats(stats);
+        return stats;
+    }
+    size_t hash(const KeyType& key) const {
+        return hasher(key);
+    }
+    template <typename K>
+    int bucket(const K& key, int len) const {
+        return hasher(key) % len;
+    }
+    HashIterator insert(const KeyType& key, const ValueType& data) {
+        return emplace(key, data);
+    }
+    // Like insert, a chain may hold equal keys: emplace always adds an entry
+    template <typename... Args>
+    HashIterator emplace(Args&&... args) {
+        std::pair<KeyType, ValueType> entry(std::forward<Args>(args)...);
+        size_t h = hasher(entry.first);
+        migrate(rehashStep);
+        grow();
+        int pos = h % length;
+        size_t index = append(array[pos], Stored(h, std::move(entry)));
+        return HashIterator(array, pos, index, length);
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    HashIterator find(const KeyType& key) {
+        return findKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    HashIterator find(const K& key) {
+        return findKey(key);
+    }
+    // Looks up keys[0..n) into out[0..n). Keys are hashed and their buckets
+    // prefetched a batch at a time, so the cache misses of the lookups overlap.
+    // An incremental rehash takes one step for the whole batch, so no bucket
+    // that out[] points into moves before the call returns.
+    void find_batch(const KeyType* keys, size_t n, HashIterator* out) {
+        migrate(rehashStep);
+        size_t h[tableBatchWidth];
+        const Chain* chain[tableBatchWidth];
+        for (size_t first = 0; first < n; first += tableBatchWidth) {
+            size_t m = std::min(tableBatchWidth, n - first);
+            for (size_t i = 0; i < m; i++) {
+                h[i] = hasher(keys[first + i]);
+                chain[i] = bucketOf(h[i]);
+                tablePrefetch(chain[i]);
+            }
+            for (size_t i = 0; i < m; i++) {
+                tablePrefetch(chain[i]->data());
+            }
+            for (size_t i = 0; i < m; i++) {
+                out[first + i] = findLocated(keys[first + i], h[i]);
+            }
+        }
+    }
+    // Sets out[i] to whether keys[i] is present; returns how many are
+    size_t contains_batch(const KeyType* keys, size_t n, bool* out) {
+        return containsBatch(*this, keys, n, out);
+    }
+    bool remove(const KeyType& key) {
+        return removeKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    bool remove(const K& key) {
+        return removeKey(key);
+    }
+    ValueType& operator[](const KeyType& key) {
+        return valueAt(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    ValueType& operator[](const K& key) {
+        return valueAt(key);
+    }
+
+    HashIterator begin() {
+        completeRehash();
+        return HashIterator::begin(array, length);
+    }
+    HashIterator end() {
+        return HashIterator(array, length, 0, length);
+    }
+    int checkCollisions() {
+        if (count > length * maxLoadFactor) {
+            return static_cast<int>(count);
+        }
+        else {
+            return 0;
+        }
+    }
+    HashTable balanceCollisions(int newLength) {
+        HashTable table(newLength, hasher, equal);
+        for (int i = migrated; i < oldLength; i++) {
+            for (auto it = oldArray[i].begin(); it != oldArray[i].end(); it++) {
+                table.place(*it);
+            }
+        }
+        for (int i = 0; i < this->length; i++) {
+            for (auto it = this->array[i].begin(); it != this->array[i].end(); it++) {
+                table.place(*it);
+            }
+        }
+        return table;
+    }
+    friend std::ostream& operator<<(std::ostream& out, const HashTable& table) {
+        for (int i = table.migrated; i < table.oldLength; i++) {
+            for (auto it = table.oldArray[i].begin(); it != table.oldArray[i].end(); it++) {
+                out << "old string: " << i << " " << "key: " << entryOf(*it).first << " " << "value: " << entryOf(*it).second << std::endl;
+            }
+        }
+        for (int i = 0; i < table.length; i++) {
+            for (auto it = table.array[i].begin(); it != table.array[i].end(); it++) {
+                out << "string: " << i << " " << "key: " << entryOf(*it).first << " " << "value: " << entryOf(*it).second << std::endl;
+            }
+        }
+        return out;
+    }
+private:
+    size_t bucketsFor(size_t n) const {
+        size_t buckets = static_cast<size_t>(n / maxLoadFactor);
+        while (buckets * maxLoadFactor < n) {
+            buckets++;
+        }
+        return buckets > 0 ? buckets : 1;
+    }
+    // Accounts for one more entry, starting a resize when it is due
+    void grow() {
+        count++;
+        if (!isRehashing() && checkCollisions()) {
+            startRehash(length * 2);
+        }
+    }
+    // The new bucket array becomes current right away; old buckets are then
+    // moved over by migrate(), rehashStep of them per operation.
+    void startRehash(int newLength) {
+        rehashStarted();
+        {
+            auto timer = rehashTimer();
+            oldArray = array;
+            oldLength = length;
+            migrated = 0;
+            array = newChains(newLength);
+            length = newLength;
+        }
+        if (rehashStep == 0 && rehashThreads > 1 && count >= parallelRehashMin) {
+            migrateParallel();
+        }
+        else {
+            migrate(rehashStep);
+        }
+    }
+    void migrate(int buckets) {
+        if (!isRehashing()) {
+            return;
+        }
+        auto timer = rehashTimer();
+        int last = (buckets == 0 || buckets > oldLength - migrated) ? oldLength : migrated + buckets;
+        for (; migrated < last; migrated++) {
+            for (auto it = oldArray[migrated].begin(); it != oldArray[migrated].end(); it++) {
+                append(array[hashOf(*it) % length], std::move(*it));
+            }
+        }
+        if (migrated == oldLength) {
+            deleteChains(oldArray, oldLength);
+            oldArray = nullptr;
+            oldLength = 0;
+            migrated = 0;
+        }
+    }
+    // Moves every old bucket into the new, still empty array with
+    // rehashThreads workers. First each worker sorts the entries of its slice
+    // of old buckets by the worker that owns their new bucket. Then each
+    // worker sizes its new chains, reserves their blocks as one arena Region
+    // and moves its entries in, so no chain grows and no lock is taken.
+    void migrateParallel() {
+        auto timer = rehashTimer();
+        struct Moved {
+            size_t bucket;
+            Stored* stored;
+        };
+        size_t workers = rehashThreads;
+        std::vector<std::vector<Moved>> parts(workers * workers); // [from][to]
+        std::vector<size_t> sizes(length, 0);
+        // worker w owns new buckets [start(w), start(w + 1))
+        auto owner = [&](size_t bucket) { return bucket * workers / length; };
+        auto start = [&](size_t w) { return (length * w + workers - 1) / workers; };
+        auto run = [&](auto work) {
+            std::vector<std::thread> threads;
+            for (size_t w = 1; w < workers; w++) {
+                threads.emplace_back(work, w);
+            }
+            work(0);
+            for (size_t t = 0; t < threads.size(); t++) {
+                threads[t].join();
+            }
+        };
+        run([&](size_t w) {
+            size_t first = oldLength * w / workers, last = oldLength * (w + 1) / workers;
+            for (size_t i = first; i < last; i++) {
+                for (auto it = oldArray[i].begin(); it != oldArray[i].end(); ++it) {
+                    size_t bucket = hashOf(*it) % length;
+                    parts[w * workers + owner(bucket)].push_back(Moved{ bucket, &*it });
+                }
+            }
+        });
+        run([&](size_t w) {
+            size_t bytes = 0;
+            for (size_t from = 0; from < workers; from++) {
+                for (const Moved& moved : parts[from * workers + w]) {
+                    sizes[moved.bucket]++;
+                }
+            }
+            size_t first = start(w), last = start(w + 1);
+            for (size_t b = first; b < last; b++) {
+                bytes += ChainArena::blockSize(sizes[b] * sizeof(Stored));
+            }
+            ChainArena::Region region(*arena, bytes);
+            for (size_t b = first; b < last; b++) {
+                array[b].reserve(sizes[b]);
+            }
+            for (size_t from = 0; from < workers; from++) {
+                for (const Moved& moved : parts[from * workers + w]) {
+                    array[moved.bucket].push_back(std::move(*moved.stored));
                 }
             }
+            for (size_t b = first; b < last; b++) {
+                sortLong(array[b]);
+            }
+        });
+        deleteChains(oldArray, oldLength);
+        oldArray = nullptr;
+        oldLength = 0;
+        migrated = 0;
+    }
+    // Fills the new, empty table from a forward range, compressed sparse row
+    // style. The first pass hashes every key and counts the entries of each
+    // bucket. Then every chain is reserved at its final size from one arena
+    // Region, so the chains lie back to back in a single allocation, in
+    // bucket order. The second pass moves the entries in, and no chain grows.
+    template <typename ForwardIt>
+    void build(ForwardIt first, ForwardIt last) {
+        size_t n = static_cast<size_t>(std::distance(first, last));
+        int newLength = static_cast<int>(bucketsFor(n));
+        deleteChains(array, length);
+        array = newChains(newLength);
+        length = newLength;
+        std::vector<size_t> hashes(n);
+        std::vector<size_t> sizes(length, 0);
+        size_t i = 0;
+        for (ForwardIt it = first; it != last; ++it, ++i) {
+            hashes[i] = hasher(static_cast<const KeyType&>((*it).first));
+            sizes[hashes[i] % length]++;
+        }
+        size_t bytes = 0;
+        for (int b = 0; b < length; b++) {
+            bytes += ChainArena::blockSize(sizes[b] * sizeof(Stored));
+        }
+        {
+            ChainArena::Region region(*arena, bytes);
+            for (int b = 0; b < length; b++) {
+                array[b].reserve(sizes[b]);
+            }
+        }
+        i = 0;
+        for (; first != last; ++first, ++i) {
+            array[hashes[i] % length].emplace_back(hashes[i], Entry(*first));
+        }
+        for (int b = 0; b < length; b++) {
+            sortLong(array[b]);
+        }
+        count = n;
+    }
+    // Sorts by hash a chain filled past treeifyThreshold without append()
+    void sortLong(Chain& chain) {
+        if (chain.size() > treeifyThreshold) {
+            std::sort(chain.begin(), chain.end(), [this](const Stored& x, const Stored& y) { return hashOf(x) < hashOf(y); });
+        }
+    }
+    // Probes: the position in a short chain, the binary search depth in a
+    // sorted one
+    static void chainStats(const Chain& chain, TableStats& stats) {
+        size_t depth = 0;
+        while ((static_cast<size_t>(1) << depth) <= chain.size()) {
+            depth++;
+        }
+        for (size_t i = 0; i < chain.size(); i++) {
+            stats.countProbe(chain.size() > treeifyThreshold ? depth : i + 1);
+        }
+    }
+    // Bucket arrays are built by hand, since every chain takes the arena
+    Chain* newChains(int n) {
+        Chain* chains = static_cast<Chain*>(::operator new(n * sizeof(Chain)));
+        for (int i = 0; i < n; i++) {
+            new (&chains[i]) Chain(ArenaAllocator<Stored>(arena.get()));
+        }
+        return chains;
+    }
+    static void deleteChains(Chain* chains, int n) {
+        if (chains == nullptr) {
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            chains[i].~Chain();
+        }
+        ::operator delete(chains);
+    }
+    // Adds an entry to a chain and returns its index there. Chains longer
+    // than treeifyThreshold are kept sorted by hash, so that a bucket that
+    // many keys fall into is binary searched rather than scanned.
+    size_t append(Chain& chain, Stored&& stored) {
+        if (chain.size() < treeifyThreshold) {
+            chain.push_back(std::move(stored));
+            return chain.size() - 1;
+        }
+        auto byHash = [this](const Stored& a, const Stored& b) { return hashOf(a) < hashOf(b); };
+        if (chain.size() == treeifyThreshold && !std::is_sorted(chain.begin(), chain.end(), byHash)) {
+            std::sort(chain.begin(), chain.end(), byHash);
+        }
+        auto it = std::upper_bound(chain.begin(), chain.end(), stored, byHash);
+        return chain.insert(it, std::move(stored)) - chain.begin();
+    }
+    // Index of the key in the chain, or -1
+    template <typename K>
+    int indexOf(const Chain& chain, size_t h, const K& key) const {
+        if (chain.size() <= treeifyThreshold) {
+            for (size_t i = 0; i < chain.size(); i++) {
+                if (matches(chain[i], h, key)) {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        }
+        auto it = std::lower_bound(chain.begin(), chain.end(), h, [this](const Stored& stored, size_t value) { return hashOf(stored) < value; });
+        for (; it != chain.end() && hashOf(*it) == h; ++it) {
+            if (equal(entryOf(*it).first, key)) {
+                return static_cast<int>(it - chain.begin());
+            }
+        }
+        return -1;
+    }
+    static Entry& entryOf(Stored& stored) {
+        if constexpr (stable) {
+            return stored.entry.get();
+        }
+        else {
+            return stored.entry;
+        }
+    }
+    static const Entry& entryOf(const Stored& stored) {
+        if constexpr (stable) {
+            return stored.entry.get();
+        }
+        else {
+            return stored.entry;
+        }
+    }
+    size_t hashOf(const Stored& stored) const {
+        if constexpr (CacheHashCode<KeyType, Hash>::value) {
+            return stored.hash;
+        }
+        else {
+            return hasher(entryOf(stored).first);
+        }
+    }
+    // Keys are only compared when the cached hashes agree
+    template <typename K>
+    bool matches(const Stored& stored, size_t h, const K& key) const {
+        if constexpr (CacheHashCode<KeyType, Hash>::value) {
+            return stored.hash == h && equal(entryOf(stored).first, key);
+        }
+        else {
+            return equal(entryOf(stored).first, key);
+        }
+    }
+    // Adds a copy of an entry of another table, reusing its hash
+    void place(const Stored& stored) {
+        grow();
+        append(array[hashOf(stored) % length], Stored(stored));
+    }
+    // Picks the bucket that holds the key: its old bucket while that one has
+    // not been migrated yet, otherwise the bucket in the current array.
+    template <typename K>
+    int locate(const K& key, size_t h, Chain*& table) {
+        if (isRehashing()) {
+            int pos = h % oldLength;
+            if (pos >= migrated && indexOf(oldArray[pos], h, key) >= 0) {
+                table = oldArray;
+                return pos;
+            }
+        }
+        table = array;
+        return h % length;
+    }
+    template <typename K>
+    HashIterator findKey(const K& key) {
+        return findHashed(key, hasher(key));
+    }
+    // The bucket a lookup of the hash reads first: its old bucket while that
+    // one has not been migrated yet
+    const Chain* bucketOf(size_t h) const {
+        if (isRehashing() && static_cast<int>(h % oldLength) >= migrated) {
+            return &oldArray[h % oldLength];
+        }
+        return &array[h % length];
+    }
+    template <typename K>
+    HashIterator findHashed(const K& key, size_t h) {
+        migrate(rehashStep);
+        return findLocated(key, h);
+    }
+    // findHashed() without the rehash step
+    template <typename K>
+    HashIterator findLocated(const K& key, size_t h) {
+        Chain* table;
+        int pos = locate(key, h, table);
+        int index = indexOf(table[pos], h, key);
+        if (index >= 0) {
+            if (table == array) {
+                return HashIterator(array, pos, index, length);
+            }
+            return HashIterator(oldArray, pos, index, oldLength, array, length);
+        }
+        return HashIterator(array, length, 0, length);
+    }
+    template <typename K>
+    bool removeKey(const K& key) {
+        migrate(rehashStep);
+        size_t h = hasher(key);
+        Chain* table;
+        int pos = locate(key, h, table);
+        int index = indexOf(table[pos], h, key);
+        if (index < 0) {
+            return false;
+        }
+        // erasing keeps a sorted chain sorted
+        table[pos].erase(table[pos].begin() + index);
+        count--;
+        return true;
+    }
+    template <typename K>
+    ValueType& valueAt(const K& key) {
+        migrate(rehashStep);
+        size_t h = hasher(key);
+        Chain* table;
+        int pos = locate(key, h, table);
+        int index = indexOf(table[pos], h, key);
+        if (index < 0) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return entryOf(table[pos][index]).second;
+    }
+    template <typename K, typename... Args>
+    std::pair<HashIterator, bool> tryEmplaceKey(K&& key, Args&&... args) {
+        size_t h = hasher(key);
+        HashIterator it = findHashed(key, h);
+        if (it != end()) {
+            return std::make_pair(it, false);
+        }
+        grow();
+        int pos = h % length;
+        size_t index = append(array[pos], Stored(h, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...)));
+        return std::make_pair(HashIterator(array, pos, index, length), true);
+    }
+};
+
+// Open addressing with Robin Hood displacement: entries live in one flat slot
+// array, each slot keeping its probe distance next to the entry (0 - empty).
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+class HashTable<KeyType, ValueType, RobinHood, Hash, KeyEqual> : private RehashLog {
+private:
+    typedef std::pair<KeyType, ValueType> Entry;
+
+    struct Slot {
+        uint32_t dist;
+        union { Entry entry; };
+        Slot() : dist(0) {}
+        ~Slot() {}
+    };
+
+    Hash hasher;
+    KeyEqual equal;
+    Slot* array;
+    size_t length; // always a power of two
+    size_t count;
+    int shift;
+public:
+    class HashIterator
+    {
+    private:
+        Slot* array_;
+        size_t counter_;
+        size_t length_;
+    public:
+        HashIterator(Slot* array, size_t counter, size_t length) : array_(array), counter_(counter), length_(length) {}
+        HashIterator& operator++()
+        {
+            counter_++;
+            while (counter_ < length_ && array_[counter_].dist == 0)
+                counter_++;
+            return *this;
+        }
+        static HashIterator begin(Slot* array, size_t length)
+        {
+            HashIterator it(array, 0, length);
+            if (array[0].dist == 0)
+                ++it;
+            return it;
+        }
+        std::pair<KeyType, ValueType>& operator*()
+        {
+            return array_[counter_].entry;
+        }
+        bool operator ==(const HashIterator& other)
+        {
+            return (array_ == other.array_ && counter_ == other.counter_);
+        }
+        bool operator !=(const HashIterator& other)
+        {
+            return !(*this == other);
+        }
+        std::pair<KeyType, ValueType>* operator->()
+        {
+            return &**this;
+        }
+    };
+    HashTable(int ptr, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash), equal(keyEqual) {
+        allocate(ptr > 0 ? ptr : 0);
+    }
+    // Sized once from the length of the range, then filled with emplace
+    template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashTable(InputIt first, InputIt last, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : HashTable(0, hash, keyEqual) {
+        reserve(rangeLength(first, last));
+        for (; first != last; ++first) {
+            emplace(*first);
+        }
+    }
+    HashTable(const HashTable& table) : RehashLog(), hasher(table.hasher), equal(table.equal) {
+        allocate(table.length);
+        for (size_t i = 0; i < table.length; i++) {
+            if (table.array[i].dist != 0) {
+                new (&array[i].entry) Entry(table.array[i].entry);
+                array[i].dist = table.array[i].dist;
+            }
+        }
+        count = table.count;
+    }
+    HashTable& operator=(const HashTable& table) {
+        if (this != &table) {
+            HashTable copy(table);
+            swap(copy);
+        }
+        return *this;
+    }
+    ~HashTable() {
+        release();
+    }
+    void swap(HashTable& table) {
+        std::swap(hasher, table.hasher);
+        std::swap(equal, table.equal);
+        std::swap(array, table.array);
+        std::swap(length, table.length);
+        std::swap(count, table.count);
+        std::swap(shift, table.shift);
+    }
+    HashIterator insert(const KeyType& key, const ValueType& data) {
+        return tryEmplaceKey(key, data).first;
+    }
+    template <typename... Args>
+    HashIterator emplace(Args&&... args) {
+        Entry entry(std::forward<Args>(args)...);
+        size_t pos = findPos(entry.first);
+        if (pos != length) {
+            return HashIterator(array, pos, length);
+        }
+        return HashIterator(array, placeNew(entry), length);
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    HashIterator find(const KeyType& key) {
+        return findKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    HashIterator find(const K& key) {
+        return findKey(key);
+    }
+    // Looks up keys[0..n) into out[0..n). Keys are hashed and their home
+    // slots prefetched a batch at a time, so the cache misses overlap.
+    void find_batch(const KeyType* keys, size_t n, HashIterator* out) {
+        size_t pos[tableBatchWidth];
+        for (size_t first = 0; first < n; first += tableBatchWidth) {
+            size_t m = std::min(tableBatchWidth, n - first);
+            for (size_t i = 0; i < m; i++) {
+                pos[i] = home(keys[first + i]);
+                tablePrefetch(&array[pos[i]]);
+            }
+            for (size_t i = 0; i < m; i++) {
+                out[first + i] = HashIterator(array, findPos(keys[first + i], pos[i]), length);
+            }
+        }
+    }
+    // Sets out[i] to whether keys[i] is present; returns how many are
+    size_t contains_batch(const KeyType* keys, size_t n, bool* out) {
+        return containsBatch(*this, keys, n, out);
+    }
+    bool remove(const KeyType& key) {
+        return removeKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    bool remove(const K& key) {
+        return removeKey(key);
+    }
+    ValueType& operator[](const KeyType& key) {
+        return valueAt(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    ValueType& operator[](const K& key) {
+        return valueAt(key);
+    }
+    size_t size() const {
+        return count;
+    }
+    float load_factor() const {
+        return static_cast<float>(count) / length;
+    }
+    size_t bucket_count() const {
+        return length;
+    }
+    // Rebuilds the slot array with at least the given number of slots (rounded
+    // up to a power of two), and never more than 7/8 full.
+    void rehash(size_t buckets) {
+        resize(std::max(buckets, slotsFor(count)));
+    }
+    // Makes room for n elements, so that inserting up to n does not resize
+    void reserve(size_t n) {
+        if (n * 8 > length * 7) {
+            resize(slotsFor(n));
+        }
+    }
+    void shrink_to_fit() {
+        rehash(0);
+    }
+    // Copies of the hash and equality policies
+    Hash hash_function() const {
+        return hasher;
+    }
+    KeyEqual key_eq() const {
+        return equal;
+    }
+    // Layout snapshot: probe lengths, empty buckets, memory and, with
+    // TABLE_STATS, rehash counts and times. Scans the whole table.
+    TableStats stats() const {
+        TableStats stats;
+        stats.size = count;
+        stats.buckets = bucket_count();
+        stats.loadFactor = load_factor();
+        for (size_t i = 0; i < length; i++) {
+            if (array[i].dist != 0) {
+                stats.countProbe(array[i].dist);
+            }
+        }
+        stats.emptyBucketRatio = static_cast<float>(length - count) / length;
+        stats.bytes = length * sizeof(Slot);
+        fillRehashStats(stats);
+        return stats;
+    }
+
+    HashIterator begin() {
+        return HashIterator::begin(array, length);
+    }
+    HashIterator end() {
+        return HashIterator(array, length, length);
+    }
+    friend std::ostream& operator<<(std::ostream& out, const HashTable& table) {
+        for (size_t i = 0; i < table.length; i++) {
+            if (table.array[i].dist != 0) {
+                out << "slot: " << i << " " << "key: " << table.array[i].entry.first << " " << "value: " << table.array[i].entry.second << std::endl;
+            }
+        }
+        return out;
+    }
+private:
+    void allocate(size_t ptr) {
+        length = 8;
+        shift = 61;
+        while (length < ptr) {
+            length *= 2;
+            shift--;
+        }
+        array = new Slot[length];
+        count = 0;
+    }
+    void release() {
+        for (size_t i = 0; i < length; i++) {
+            if (array[i].dist != 0) {
+                array[i].entry.~Entry();
+            }
+        }
+        delete[] array;
+    }
+    template <typename K>
+    size_t home(const K& key) const {
+        // Fibonacci hashing: take the top bits so that weak hashes still spread
+        return (static_cast<uint64_t>(hasher(key)) * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+    template <typename K>
+    size_t findPos(const K& key) const {
+        return findPos(key, home(key));
+    }
+    // Probes from pos, which must be the home slot of the key
+    template <typename K>
+    size_t findPos(const K& key, size_t pos) const {
+        size_t mask = length - 1;
+        for (uint32_t d = 1; array[pos].dist >= d; d++) {
+            if (equal(array[pos].entry.first, key)) {
+                return pos;
+            }
+            pos = (pos + 1) & mask;
+        }
+        return length;
+    }
+    // Places the entry, displacing richer ones on the way, and returns the
+    // slot the entry itself ended up in.
+    size_t place(Entry& entry) {
+        size_t mask = length - 1;
+        size_t pos = home(entry.first);
+        size_t result = length;
+        uint32_t d = 1;
+        while (array[pos].dist != 0) {
+            if (array[pos].dist < d) {
+                std::swap(entry, array[pos].entry);
+                std::swap(d, array[pos].dist);
+                if (result == length) {
+                    result = pos;
+                }
+            }
+            pos = (pos + 1) & mask;
+            d++;
+        }
+        new (&array[pos].entry) Entry(std::move(entry));
+        array[pos].dist = d;
+        return result == length ? pos : result;
+    }
+    // Entries move during displacement anyway, so they are built up front
+    size_t placeNew(Entry& entry) {
+        if ((count + 1) * 8 > length * 7) {
+            resize(length * 2);
+        }
+        count++;
+        return place(entry);
+    }
+    template <typename K, typename... Args>
+    std::pair<HashIterator, bool> tryEmplaceKey(K&& key, Args&&... args) {
+        size_t pos = findPos(key);
+        if (pos != length) {
+            return std::make_pair(HashIterator(array, pos, length), false);
+        }
+        Entry entry(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::make_pair(HashIterator(array, placeNew(entry), length), true);
+    }
+    static size_t slotsFor(size_t n) {
+        return n + (n + 6) / 7;
+    }
+    void resize(size_t newLength) {
+        rehashStarted();
+        auto timer = rehashTimer();
+        HashTable table(static_cast<int>(newLength), hasher, equal);
+        for (size_t i = 0; i < length; i++) {
+            if (array[i].dist != 0) {
+                table.place(array[i].entry);
+                table.count++;
+            }
+        }
+        swap(table);
+    }
+    template <typename K>
+    HashIterator findKey(const K& key) {
+        return HashIterator(array, findPos(key), length);
+    }
+    template <typename K>
+    bool removeKey(const K& key) {
+        size_t pos = findPos(key);
+        if (pos == length) {
+            return false;
+        }
+        // backward shift: pull the rest of the cluster one slot closer to home
+        size_t mask = length - 1;
+        size_t next = (pos + 1) & mask;
+        while (array[next].dist > 1) {
+            array[pos].entry = std::move(array[next].entry);
+            array[pos].dist = array[next].dist - 1;
+            pos = next;
+            next = (next + 1) & mask;
+        }
+        array[pos].entry.~Entry();
+        array[pos].dist = 0;
+        count--;
+        return true;
+    }
+    template <typename K>
+    ValueType& valueAt(const K& key) {
+        size_t pos = findPos(key);
+        if (pos == length) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return array[pos].entry.second;
+    }
+};
+
+// One group of control bytes for GroupProbing. A control byte is either
+// kEmpty, kDeleted or, for a full slot, the low 7 bits of the key hash.
+// Each match* function returns a bitmask with bit i set for matching byte i.
+struct ControlGroup {
+    static constexpr int width = 16;
+    static constexpr signed char kEmpty = -128;
+    static constexpr signed char kDeleted = -2;
+
+#ifdef TABLE_SSE2
+    __m128i ctrl;
+    explicit ControlGroup(const signed char* pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+    uint32_t match(signed char h2) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+    }
+    uint32_t matchEmpty() const {
+        return match(kEmpty);
+    }
+    uint32_t matchEmptyOrDeleted() const {
+        // full bytes are 0..127, so the sign bit marks empty and deleted ones
+        return _mm_movemask_epi8(ctrl);
+    }
+#else
+    const signed char* ctrl;
+    explicit ControlGroup(const signed char* pos) : ctrl(pos) {}
+    uint32_t match(signed char h2) const {
+        uint32_t mask = 0;
+        for (int i = 0; i < width; i++) {
+            if (ctrl[i] == h2)
+                mask |= 1u << i;
+        }
+        return mask;
+    }
+    uint32_t matchEmpty() const {
+        return match(kEmpty);
+    }
+    uint32_t matchEmptyOrDeleted() const {
+        uint32_t mask = 0;
+        for (int i = 0; i < width; i++) {
+            if (ctrl[i] < 0)
+                mask |= 1u << i;
+        }
+        return mask;
+    }
+#endif
+    static int lowestBit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(mask);
+#else
+        int i = 0;
+        while (!(mask & 1u)) {
+            mask >>= 1;
+            i++;
+        }
+        return i;
+#endif
+    }
+};
+
+// Swiss-table style open addressing: one control byte per slot, probed a whole
+// aligned group of ControlGroup::width slots at a time.
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+class HashTable<KeyType, ValueType, GroupProbing, Hash, KeyEqual> : private RehashLog {
+private:
+    typedef std::pair<KeyType, ValueType> Entry;
+
+    union Slot {
+        Entry entry;
+        Slot() {}
+        ~Slot() {}
+    };
+
+    Hash hasher;
+    KeyEqual equal;
+    signed char* ctrl;
+    Slot* array;
+    size_t length; // a power of two, at least one group
+    size_t count;
+    size_t deleted;
+public:
+    class HashIterator
+    {
+    private:
+        signed char* ctrl_;
+        Slot* array_;
+        size_t counter_;
+        size_t length_;
+    public:
+        HashIterator(signed char* ctrl, Slot* array, size_t counter, size_t length) : ctrl_(ctrl), array_(array), counter_(counter), length_(length) {}
+        HashIterator& operator++()
+        {
+            counter_++;
+            while (counter_ < length_ && ctrl_[counter_] < 0)
+                counter_++;
+            return *this;
+        }
+        static HashIterator begin(signed char* ctrl, Slot* array, size_t length)
+        {
+            HashIterator it(ctrl, array, 0, length);
+            if (ctrl[0] < 0)
+                ++it;
+            return it;
+        }
+        std::pair<KeyType, ValueType>& operator*()
+        {
+            return array_[counter_].entry;
+        }
+        bool operator ==(const HashIterator& other)
+        {
+            return (array_ == other.array_ && counter_ == other.counter_);
+        }
+        bool operator !=(const HashIterator& other)
+        {
+            return !(*this == other);
+        }
+        std::pair<KeyType, ValueType>* operator->()
+        {
+            return &**this;
+        }
+    };
+    HashTable(int ptr, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash), equal(keyEqual) {
+        allocate(ptr > 0 ? ptr : 0);
+    }
+    // Sized once from the length of the range, then filled with emplace
+    template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashTable(InputIt first, InputIt last, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : HashTable(0, hash, keyEqual) {
+        reserve(rangeLength(first, last));
+        for (; first != last; ++first) {
+            emplace(*first);
+        }
+    }
+    HashTable(const HashTable& table) : RehashLog(), hasher(table.hasher), equal(table.equal) {
+        allocate(table.length);
+        for (size_t i = 0; i < table.length; i++) {
+            ctrl[i] = table.ctrl[i];
+            if (ctrl[i] >= 0) {
+                new (&array[i].entry) Entry(table.array[i].entry);
+            }
+        }
+        count = table.count;
+        deleted = table.deleted;
+    }
+    HashTable& operator=(const HashTable& table) {
+        if (this != &table) {
+            HashTable copy(table);
+            swap(copy);
+        }
+        return *this;
+    }
+    ~HashTable() {
+        release();
+    }
+    void swap(HashTable& table) {
+        std::swap(hasher, table.hasher);
+        std::swap(equal, table.equal);
+        std::swap(ctrl, table.ctrl);
+        std::swap(array, table.array);
+        std::swap(length, table.length);
+        std::swap(count, table.count);
+        std::swap(deleted, table.deleted);
+    }
+    HashIterator insert(const KeyType& key, const ValueType& data) {
+        return tryEmplaceKey(key, data).first;
+    }
+    template <typename... Args>
+    HashIterator emplace(Args&&... args) {
+        Entry entry(std::forward<Args>(args)...);
+        size_t h = hash(entry.first);
+        size_t pos = findPos(entry.first, h);
+        if (pos != length) {
+            return HashIterator(ctrl, array, pos, length);
+        }
+        pos = prepareInsert(h);
+        new (&array[pos].entry) Entry(std::move(entry));
+        markFull(pos, h);
+        return HashIterator(ctrl, array, pos, length);
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    HashIterator find(const KeyType& key) {
+        return findKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    HashIterator find(const K& key) {
+        return findKey(key);
+    }
+    // Looks up keys[0..n) into out[0..n). Keys are hashed and their first
+    // groups prefetched a batch at a time, so the cache misses overlap.
+    void find_batch(const KeyType* keys, size_t n, HashIterator* out) {
+        size_t h[tableBatchWidth];
+        size_t groupMask = length / ControlGroup::width - 1;
+        for (size_t first = 0; first < n; first += tableBatchWidth) {
+            size_t m = std::min(tableBatchWidth, n - first);
+            for (size_t i = 0; i < m; i++) {
+                h[i] = hash(keys[first + i]);
+                size_t base = ((h[i] >> 7) & groupMask) * ControlGroup::width;
+                tablePrefetch(ctrl + base);
+                tablePrefetch(array + base);
+            }
+            for (size_t i = 0; i < m; i++) {
+                out[first + i] = HashIterator(ctrl, array, findPos(keys[first + i], h[i]), length);
+            }
+        }
+    }
+    // Sets out[i] to whether keys[i] is present; returns how many are
+    size_t contains_batch(const KeyType* keys, size_t n, bool* out) {
+        return containsBatch(*this, keys, n, out);
+    }
+    bool remove(const KeyType& key) {
+        return removeKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    bool remove(const K& key) {
+        return removeKey(key);
+    }
+    ValueType& operator[](const KeyType& key) {
+        return valueAt(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    ValueType& operator[](const K& key) {
+        return valueAt(key);
+    }
+    size_t size() const {
+        return count;
+    }
+    float load_factor() const {
+        return static_cast<float>(count) / length;
+    }
+    size_t bucket_count() const {
+        return length;
+    }
+    // Rebuilds the slot array with at least the given number of slots (rounded
+    // up to a power of two), and never more than 7/8 full. Drops tombstones.
+    void rehash(size_t buckets) {
+        resize(std::max(buckets, slotsFor(count)));
+    }
+    // Makes room for n elements, so that inserting up to n does not resize
+    void reserve(size_t n) {
+        if ((n + deleted) * 8 > length * 7) {
+            resize(std::max(length, slotsFor(n)));
+        }
+    }
+    void shrink_to_fit() {
+        rehash(0);
+    }
+    // Copies of the hash and equality policies
+    Hash hash_function() const {
+        return hasher;
+    }
+    KeyEqual key_eq() const {
+        return equal;
+    }
+    // Layout snapshot: probe lengths, empty buckets, memory and, with
+    // TABLE_STATS, rehash counts and times. Scans the whole table.
+    TableStats stats() const {
+        TableStats stats;
+        stats.size = count;
+        stats.buckets = bucket_count();
+        stats.loadFactor = load_factor();
+        size_t groupMask = length / ControlGroup::width - 1;
+        for (size_t i = 0; i < length; i++) {
+            if (ctrl[i] >= 0) {
+                // groups findPos walks through before it reaches slot i
+                size_t group = (hash(array[i].entry.first) >> 7) & groupMask;
+                size_t probes = 1;
+                for (size_t step = 1; group != i / ControlGroup::width; step++) {
+                    group = (group + step) & groupMask;
+                    probes++;
+                }
+                stats.countProbe(probes);
+            }
+        }
+        stats.emptyBucketRatio = static_cast<float>(length - count) / length;
+        stats.bytes = length * (sizeof(Slot) + 1);
+        fillRehashStats(stats);
+        return stats;
+    }
+
+    HashIterator begin() {
+        return HashIterator::begin(ctrl, array, length);
+    }
+    HashIterator end() {
+        return HashIterator(ctrl, array, length, length);
+    }
+    friend std::ostream& operator<<(std::ostream& out, const HashTable& table) {
+        for (size_t i = 0; i < table.length; i++) {
+            if (table.ctrl[i] >= 0) {
+                out << "slot: " << i << " " << "key: " << table.array[i].entry.first << " " << "value: " << table.array[i].entry.second << std::endl;
+            }
+        }
+        return out;
+    }
+private:
+    void allocate(size_t ptr) {
+        length = ControlGroup::width;
+        while (length < ptr) {
+            length *= 2;
+        }
+        ctrl = new signed char[length];
+        std::fill(ctrl, ctrl + length, ControlGroup::kEmpty);
+        array = new Slot[length];
+        count = 0;
+        deleted = 0;
+    }
+    void release() {
+        for (size_t i = 0; i < length; i++) {
+            if (ctrl[i] >= 0) {
+                array[i].entry.~Entry();
+            }
+        }
+        delete[] array;
+        delete[] ctrl;
+    }
+    template <typename K>
+    size_t hash(const K& key) const {
+        uint64_t h = static_cast<uint64_t>(hasher(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+    // Triangular probing over whole groups; visits every group exactly once
+    // because the number of groups is a power of two.
+    template <typename K>
+    size_t findPos(const K& key, size_t h) const {
+        size_t groupMask = length / ControlGroup::width - 1;
+        size_t group = (h >> 7) & groupMask;
+        signed char h2 = static_cast<signed char>(h & 0x7F);
+        for (size_t step = 1; ; step++) {
+            size_t base = group * ControlGroup::width;
+            ControlGroup g(ctrl + base);
+            for (uint32_t mask = g.match(h2); mask; mask &= mask - 1) {
+                size_t pos = base + ControlGroup::lowestBit(mask);
+                if (equal(array[pos].entry.first, key)) {
+                    return pos;
+                }
+            }
+            if (g.matchEmpty() || step > groupMask) {
+                return length;
+            }
+            group = (group + step) & groupMask;
+        }
+    }
+    size_t freePos(size_t h) const {
+        size_t groupMask = length / ControlGroup::width - 1;
+        size_t group = (h >> 7) & groupMask;
+        for (size_t step = 1; ; step++) {
+            size_t base = group * ControlGroup::width;
+            uint32_t mask = ControlGroup(ctrl + base).matchEmptyOrDeleted();
+            if (mask) {
+                return base + ControlGroup::lowestBit(mask);
+            }
+            group = (group + step) & groupMask;
+        }
+    }
+    // Returns the slot a new entry with hash h goes to, growing if needed
+    size_t prepareInsert(size_t h) {
+        if ((count + deleted + 1) * 8 > length * 7) {
+            // mostly tombstones: rebuild in place, otherwise grow
+            resize(count * 2 < length ? length : length * 2);
+        }
+        return freePos(h);
+    }
+    void markFull(size_t pos, size_t h) {
+        if (ctrl[pos] == ControlGroup::kDeleted) {
+            deleted--;
+        }
+        ctrl[pos] = static_cast<signed char>(h & 0x7F);
+        count++;
+    }
+    // Swiss slots never move on insert, so the entry is built in place
+    template <typename K, typename... Args>
+    std::pair<HashIterator, bool> tryEmplaceKey(K&& key, Args&&... args) {
+        size_t h = hash(key);
+        size_t pos = findPos(key, h);
+        if (pos != length) {
+            return std::make_pair(HashIterator(ctrl, array, pos, length), false);
+        }
+        pos = prepareInsert(h);
+        new (&array[pos].entry) Entry(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        markFull(pos, h);
+        return std::make_pair(HashIterator(ctrl, array, pos, length), true);
+    }
+    static size_t slotsFor(size_t n) {
+        return n + (n + 6) / 7;
+    }
+    void resize(size_t newLength) {
+        rehashStarted();
+        auto timer = rehashTimer();
+        HashTable table(static_cast<int>(newLength), hasher, equal);
+        for (size_t i = 0; i < length; i++) {
+            if (ctrl[i] >= 0) {
+                size_t h = hash(array[i].entry.first);
+                size_t pos = table.freePos(h);
+                new (&table.array[pos].entry) Entry(std::move(array[i].entry));
+                table.ctrl[pos] = static_cast<signed char>(h & 0x7F);
+                table.count++;
+            }
+        }
+        swap(table);
+    }
+    template <typename K>
+    HashIterator findKey(const K& key) {
+        return HashIterator(ctrl, array, findPos(key, hash(key)), length);
+    }
+    template <typename K>
+    bool removeKey(const K& key) {
+        size_t pos = findPos(key, hash(key));
+        if (pos == length) {
+            return false;
+        }
+        array[pos].entry.~Entry();
+        // probes stop at the first group with an empty slot, so when this
+        // group still has one no probe sequence can run through it
+        size_t group = pos & ~static_cast<size_t>(ControlGroup::width - 1);
+        if (ControlGroup(ctrl + group).matchEmpty()) {
+            ctrl[pos] = ControlGroup::kEmpty;
+        }
+        else {
+            ctrl[pos] = ControlGroup::kDeleted;
+            deleted++;
+        }
+        count--;
+        return true;
+    }
+    template <typename K>
+    ValueType& valueAt(const K& key) {
+        size_t pos = findPos(key, hash(key));
+        if (pos == length) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return array[pos].entry.second;
+    }
+};
+
+// Bucketized cuckoo hashing: a key lives in one of two buckets of
+// slotsPerBucket slots, so a lookup reads at most two buckets. A one byte tag
+// per slot filters key comparisons and also gives the other bucket of an
+// entry without hashing its key again (partial-key cuckoo hashing).
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+class HashTable<KeyType, ValueType, Cuckoo, Hash, KeyEqual> : private RehashLog {
+private:
+    typedef std::pair<KeyType, ValueType> Entry;
+
+    static constexpr size_t slotsPerBucket = 4;
+    static constexpr size_t maxPathLength = 5; // entries moved by one insert
+    static constexpr size_t maxSearch = 256;   // buckets one insert examines
+
+    union Slot {
+        Entry entry;
+        Slot() {}
+        ~Slot() {}
+    };
+
+    struct Bucket {
+        uint8_t tags[slotsPerBucket]; // 0 - empty
+        Slot slots[slotsPerBucket];
+        Bucket() : tags() {}
+    };
+
+    // A bucket on an eviction path, reached by moving out the entry in
+    // slot `slot` of the bucket of step `parent`
+    struct Step {
+        size_t bucket;
+        int parent;
+        int slot;
+    };
+
+    Hash hasher;
+    KeyEqual equal;
+    Bucket* array;
+    size_t length; // buckets, always a power of two
+    size_t count;
+public:
+    class HashIterator
+    {
+    private:
+        Bucket* array_;
+        size_t counter_;
+        size_t length_;
+    public:
+        HashIterator(Bucket* array, size_t counter, size_t length) : array_(array), counter_(counter), length_(length) {}
+        HashIterator& operator++()
+        {
+            counter_++;
+            while (counter_ < length_ && array_[counter_ / slotsPerBucket].tags[counter_ % slotsPerBucket] == 0)
+                counter_++;
+            return *this;
+        }
+        static HashIterator begin(Bucket* array, size_t length)
+        {
+            HashIterator it(array, 0, length);
+            if (array[0].tags[0] == 0)
+                ++it;
+            return it;
+        }
+        std::pair<KeyType, ValueType>& operator*()
+        {
+            return array_[counter_ / slotsPerBucket].slots[counter_ % slotsPerBucket].entry;
+        }
+        bool operator ==(const HashIterator& other)
+        {
+            return (array_ == other.array_ && counter_ == other.counter_);
+        }
+        bool operator !=(const HashIterator& other)
+        {
+            return !(*this == other);
+        }
+        std::pair<KeyType, ValueType>* operator->()
+        {
+            return &**this;
+        }
+    };
+    HashTable(int ptr, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash), equal(keyEqual) {
+        allocate(ptr > 0 ? ptr : 0);
+    }
+    // Sized once from the length of the range, then filled with emplace
+    template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashTable(InputIt first, InputIt last, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : HashTable(0, hash, keyEqual) {
+        reserve(rangeLength(first, last));
+        for (; first != last; ++first) {
+            emplace(*first);
+        }
+    }
+    HashTable(const HashTable& table) : RehashLog(), hasher(table.hasher), equal(table.equal) {
+        allocate(table.length * slotsPerBucket);
+        for (size_t b = 0; b < table.length; b++) {
+            for (size_t s = 0; s < slotsPerBucket; s++) {
+                if (table.array[b].tags[s] != 0) {
+                    new (&array[b].slots[s].entry) Entry(table.array[b].slots[s].entry);
+                    array[b].tags[s] = table.array[b].tags[s];
+                }
+            }
+        }
+        count = table.count;
+    }
+    HashTable& operator=(const HashTable& table) {
+        if (this != &table) {
+            HashTable copy(table);
+            swap(copy);
+        }
+        return *this;
+    }
+    ~HashTable() {
+        release();
+    }
+    void swap(HashTable& table) {
+        std::swap(hasher, table.hasher);
+        std::swap(equal, table.equal);
+        std::swap(array, table.array);
+        std::swap(length, table.length);
+        std::swap(count, table.count);
+    }
+    HashIterator insert(const KeyType& key, const ValueType& data) {
+        return tryEmplaceKey(key, data).first;
+    }
+    template <typename... Args>
+    HashIterator emplace(Args&&... args) {
+        Entry entry(std::forward<Args>(args)...);
+        uint64_t h = hash(entry.first);
+        size_t pos = findPos(entry.first, h);
+        if (pos != capacity()) {
+            return HashIterator(array, pos, capacity());
+        }
+        pos = placeNew(entry, h);
+        return HashIterator(array, pos, capacity());
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    HashIterator find(const KeyType& key) {
+        return findKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    HashIterator find(const K& key) {
+        return findKey(key);
+    }
+    // Looks up keys[0..n) into out[0..n). Keys are hashed and both of their
+    // buckets prefetched a batch at a time, so the cache misses overlap.
+    void find_batch(const KeyType* keys, size_t n, HashIterator* out) {
+        uint64_t h[tableBatchWidth];
+        for (size_t first = 0; first < n; first += tableBatchWidth) {
+            size_t m = std::min(tableBatchWidth, n - first);
+            for (size_t i = 0; i < m; i++) {
+                h[i] = hash(keys[first + i]);
+                size_t b = h[i] & (length - 1);
+                tablePrefetch(&array[b]);
+                tablePrefetch(&array[alt(b, tagOf(h[i]))]);
+            }
+            for (size_t i = 0; i < m; i++) {
+                out[first + i] = HashIterator(array, findPos(keys[first + i], h[i]), capacity());
+            }
+        }
+    }
+    // Sets out[i] to whether keys[i] is present; returns how many are
+    size_t contains_batch(const KeyType* keys, size_t n, bool* out) {
+        return containsBatch(*this, keys, n, out);
+    }
+    bool remove(const KeyType& key) {
+        return removeKey(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    bool remove(const K& key) {
+        return removeKey(key);
+    }
+    ValueType& operator[](const KeyType& key) {
+        return valueAt(key);
+    }
+    template <typename K, typename H = Hash, typename = typename std::enable_if<TransparentPolicies<H, KeyEqual>::value>::type>
+    ValueType& operator[](const K& key) {
+        return valueAt(key);
+    }
+    size_t size() const {
+        return count;
+    }
+    float load_factor() const {
+        return static_cast<float>(count) / capacity();
+    }
+    // Counted in slots, like the other open-addressing engines
+    size_t bucket_count() const {
+        return capacity();
+    }
+    // Rebuilds the table with at least the given number of slots (rounded up
+    // to whole buckets and a power of two), and never more than 9/10 full.
+    void rehash(size_t buckets) {
+        resize(std::max(buckets, slotsFor(count)));
+    }
+    // Makes room for n elements, so that inserting up to n does not resize
+    // unless an eviction path cannot be found
+    void reserve(size_t n) {
+        if (n * 10 > capacity() * 9) {
+            resize(slotsFor(n));
+        }
+    }
+    void shrink_to_fit() {
+        rehash(0);
+    }
+    // Copies of the hash and equality policies
+    Hash hash_function() const {
+        return hasher;
+    }
+    KeyEqual key_eq() const {
+        return equal;
+    }
+    // Layout snapshot: probe lengths, empty buckets, memory and, with
+    // TABLE_STATS, rehash counts and times. Scans the whole table.
+    TableStats stats() const {
+        TableStats stats;
+        stats.size = count;
+        stats.buckets = bucket_count();
+        stats.loadFactor = load_factor();
+        for (size_t b = 0; b < length; b++) {
+            for (size_t s = 0; s < slotsPerBucket; s++) {
+                if (array[b].tags[s] != 0) {
+                    // 1 in the key's first bucket, 2 in its alternate one
+                    stats.countProbe((hash(array[b].slots[s].entry.first) & (length - 1)) == b ? 1 : 2);
+                }
+            }
+        }
+        stats.emptyBucketRatio = static_cast<float>(capacity() - count) / capacity();
+        stats.bytes = length * sizeof(Bucket);
+        fillRehashStats(stats);
+        return stats;
+    }
+
+    HashIterator begin() {
+        return HashIterator::begin(array, capacity());
+    }
+    HashIterator end() {
+        return HashIterator(array, capacity(), capacity());
+    }
+    friend std::ostream& operator<<(std::ostream& out, const HashTable& table) {
+        for (size_t b = 0; b < table.length; b++) {
+            for (size_t s = 0; s < slotsPerBucket; s++) {
+                if (table.array[b].tags[s] != 0) {
+                    out << "slot: " << b * slotsPerBucket + s << " " << "key: " << table.array[b].slots[s].entry.first << " " << "value: " << table.array[b].slots[s].entry.second << std::endl;
+                }
+            }
+        }
+        return out;
+    }
+private:
+    void allocate(size_t ptr) {
+        length = 2;
+        while (length * slotsPerBucket < ptr) {
+            length *= 2;
+        }
+        array = new Bucket[length];
+        count = 0;
+    }
+    void release() {
+        for (size_t b = 0; b < length; b++) {
+            for (size_t s = 0; s < slotsPerBucket; s++) {
+                if (array[b].tags[s] != 0) {
+                    array[b].slots[s].entry.~Entry();
+                }
+            }
+        }
+        delete[] array;
+    }
+    size_t capacity() const {
+        return length * slotsPerBucket;
+    }
+    template <typename K>
+    uint64_t hash(const K& key) const {
+        return hashMix(hasher(key));
+    }
+    static uint8_t tagOf(uint64_t h) {
+        uint8_t tag = static_cast<uint8_t>(h >> 56);
+        return tag != 0 ? tag : 1;
+    }
+    // The other bucket of an entry; alt(alt(b, tag), tag) == b
+    size_t alt(size_t bucket, uint8_t tag) const {
+        return (bucket ^ (tag * 0xc6a4a7935bd1e995ull)) & (length - 1);
+    }
+    template <typename K>
+    size_t findIn(size_t b, uint8_t tag, const K& key) const {
+        for (size_t s = 0; s < slotsPerBucket; s++) {
+            if (array[b].tags[s] == tag && equal(array[b].slots[s].entry.first, key)) {
+                return b * slotsPerBucket + s;
+            }
+        }
+        return capacity();
+    }
+    template <typename K>
+    size_t findPos(const K& key, uint64_t h) const {
+        uint8_t tag = tagOf(h);
+        size_t b = h & (length - 1);
+        size_t pos = findIn(b, tag, key);
+        if (pos == capacity()) {
+            pos = findIn(alt(b, tag), tag, key);
+        }
+        return pos;
+    }
+    int emptySlot(size_t b) const {
+        for (size_t s = 0; s < slotsPerBucket; s++) {
+            if (array[b].tags[s] == 0) {
+                return static_cast<int>(s);
+            }
+        }
+        return -1;
+    }
+    void moveEntry(size_t fromBucket, size_t fromSlot, size_t toBucket, size_t toSlot) {
+        new (&array[toBucket].slots[toSlot].entry) Entry(std::move(array[fromBucket].slots[fromSlot].entry));
+        array[toBucket].tags[toSlot] = array[fromBucket].tags[fromSlot];
+        array[fromBucket].slots[fromSlot].entry.~Entry();
+        array[fromBucket].tags[fromSlot] = 0;
+    }
+    static bool onPath(const Step* steps, int step, size_t bucket) {
+        for (; step >= 0; step = steps[step].parent) {
+            if (steps[step].bucket == bucket) {
+                return true;
+            }
+        }
+        return false;
+    }
+    // Breadth-first search for the shortest chain of evictions that frees a
+    // slot in one of the two buckets; returns the freed slot or capacity().
+    size_t makeRoom(size_t b1, size_t b2) {
+        Step steps[maxSearch];
+        size_t head = 0, tail = 0;
+        steps[tail++] = Step{ b1, -1, -1 };
+        if (b2 != b1) {
+            steps[tail++] = Step{ b2, -1, -1 };
+        }
+        while (head < tail) {
+            int cur = static_cast<int>(head++);
+            size_t depth = 0;
+            for (int p = steps[cur].parent; p >= 0; p = steps[p].parent) {
+                depth++;
+            }
+            for (size_t s = 0; s < slotsPerBucket; s++) {
+                size_t next = alt(steps[cur].bucket, array[steps[cur].bucket].tags[s]);
+                if (onPath(steps, cur, next)) {
+                    continue;
+                }
+                int empty = emptySlot(next);
+                if (empty >= 0) {
+                    // shift every entry on the path one step, last one first
+                    size_t toBucket = next, toSlot = empty;
+                    size_t slot = s;
+                    for (int step = cur; step >= 0; step = steps[step].parent) {
+                        moveEntry(steps[step].bucket, slot, toBucket, toSlot);
+                        toBucket = steps[step].bucket;
+                        toSlot = slot;
+                        slot = steps[step].slot;
+                    }
+                    return toBucket * slotsPerBucket + toSlot;
+                }
+                if (depth + 1 < maxPathLength && tail < maxSearch) {
+                    steps[tail++] = Step{ next, cur, static_cast<int>(s) };
+                }
+            }
+        }
+        return capacity();
+    }
+    size_t freePos(uint64_t h) {
+        size_t b1 = h & (length - 1);
+        size_t b2 = alt(b1, tagOf(h));
+        int s = emptySlot(b1);
+        if (s >= 0) {
+            return b1 * slotsPerBucket + s;
+        }
+        s = emptySlot(b2);
+        if (s >= 0) {
+            return b2 * slotsPerBucket + s;
+        }
+        return makeRoom(b1, b2);
+    }
+    // Grows when no eviction path is found
+    size_t placeNew(Entry& entry, uint64_t h) {
+        if ((count + 1) * 10 > capacity() * 9) {
+            resize(capacity() * 2);
+        }
+        size_t pos = freePos(h);
+        while (pos == capacity()) {
+            resize(capacity() * 2);
+            pos = freePos(h);
+        }
+        new (&array[pos / slotsPerBucket].slots[pos % slotsPerBucket].entry) Entry(std::move(entry));
+        array[pos / slotsPerBucket].tags[pos % slotsPerBucket] = tagOf(h);
+        count++;
+        return pos;
+    }
+    template <typename K, typename... Args>
+    std::pair<HashIterator, bool> tryEmplaceKey(K&& key, Args&&... args) {
+        uint64_t h = hash(key);
+        size_t pos = findPos(key, h);
+        if (pos != capacity()) {
+            return std::make_pair(HashIterator(array, pos, capacity()), false);
+        }
+        Entry entry(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+        pos = placeNew(entry, h);
+        return std::make_pair(HashIterator(array, pos, capacity()), true);
+    }
+    static size_t slotsFor(size_t n) {
+        return n + (n + 8) / 9;
+    }
+    void resize(size_t newCapacity) {
+        rehashStarted();
+        auto timer = rehashTimer();
+        HashTable table(static_cast<int>(newCapacity), hasher, equal);
+        for (size_t b = 0; b < length; b++) {
+            for (size_t s = 0; s < slotsPerBucket; s++) {
+                if (array[b].tags[s] != 0) {
+                    table.placeNew(array[b].slots[s].entry, table.hash(array[b].slots[s].entry.first));
+                }
+            }
+        }
+        swap(table);
+    }
+    template <typename K>
+    HashIterator findKey(const K& key) {
+        return HashIterator(array, findPos(key, hash(key)), capacity());
+    }
+    template <typename K>
+    bool removeKey(const K& key) {
+        size_t pos = findPos(key, hash(key));
+        if (pos == capacity()) {
+            return false;
+        }
+        array[pos / slotsPerBucket].slots[pos % slotsPerBucket].entry.~Entry();
+        array[pos / slotsPerBucket].tags[pos % slotsPerBucket] = 0;
+        count--;
+        return true;
+    }
+    template <typename K>
+    ValueType& valueAt(const K& key) {
+        size_t pos = findPos(key, hash(key));
+        if (pos == capacity()) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return array[pos / slotsPerBucket].slots[pos % slotsPerBucket].entry.second;
+    }
+};
+
+// Key reserved by the Flat engine to mark empty slots; it cannot be stored.
+// Specialize it to reserve another key.
+template <typename KeyType, typename Enable = void>
+struct FlatEmptyKey {
+    static constexpr KeyType value() {
+        return std::numeric_limits<KeyType>::min();
+    }
+};
+
+// numeric_limits knows nothing of enums (its min() would be 0, usually the
+// first enumerator), so they reserve the value of their underlying type that
+// lies furthest from 0: the least if it is signed, the greatest if not.
+// An enum without a fixed underlying type only holds the values its
+// enumerators span, so it needs a specialization of its own.
+template <typename KeyType>
+struct FlatEmptyKey<KeyType, typename std::enable_if<std::is_enum<KeyType>::value>::type> {
+    static constexpr KeyType value() {
+        typedef typename std::underlying_type<KeyType>::type Underlying;
+        return static_cast<KeyType>(std::is_signed<Underlying>::value ? std::numeric_limits<Underlying>::min()
+                                                                      : std::numeric_limits<Underlying>::max());
+    }
+};
+
+// Struct-of-arrays linear probing for integral keys: keys sit in one dense
+// array (empty slots hold FlatEmptyKey), values in a parallel one, so a probe
+// only reads key memory. Entries are not pairs; the iterator yields a pair
+// of references instead.
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual>
+class HashTable<KeyType, ValueType, Flat, Hash, KeyEqual> : private RehashLog {
+    static_assert(std::is_integral<KeyType>::value || std::is_enum<KeyType>::value, "Flat needs an integral key type");
+private:
+    union ValueSlot {
+        ValueType value;
+        ValueSlot() {}
+        ~ValueSlot() {}
+    };
+
+    Hash hasher;
+    KeyEqual equal;
+    KeyType* keys;
+    ValueSlot* values;
+    size_t length; // always a power of two
+    size_t count;
+    int shift;
+
+    static constexpr KeyType empty() {
+        return FlatEmptyKey<KeyType>::value();
+    }
+public:
+    struct EntryRef {
+        const KeyType& first;
+        ValueType& second;
+    };
+    class HashIterator
+    {
+    private:
+        KeyType* keys_;
+        ValueSlot* values_;
+        size_t counter_;
+        size_t length_;
+    public:
+        struct Arrow {
+            EntryRef ref;
+            EntryRef* operator->() { return &ref; }
+        };
+        HashIterator(KeyType* keys, ValueSlot* values, size_t counter, size_t length) : keys_(keys), values_(values), counter_(counter), length_(length) {}
+        HashIterator& operator++()
+        {
+            counter_++;
+            while (counter_ < length_ && keys_[counter_] == empty())
+                counter_++;
+            return *this;
+        }
+        static HashIterator begin(KeyType* keys, ValueSlot* values, size_t length)
+        {
+            HashIterator it(keys, values, 0, length);
+            if (keys[0] == empty())
+                ++it;
+            return it;
+        }
+        EntryRef operator*()
+        {
+            return EntryRef{ keys_[counter_], values_[counter_].value };
+        }
+        bool operator ==(const HashIterator& other)
+        {
+            return (keys_ == other.keys_ && counter_ == other.counter_);
+        }
+        bool operator !=(const HashIterator& other)
+        {
+            return !(*this == other);
+        }
+        Arrow operator->()
+        {
+            return Arrow{ **this };
+        }
+    };
+    HashTable(int ptr, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : hasher(hash), equal(keyEqual) {
+        allocate(ptr > 0 ? ptr : 0);
+    }
+    // Sized once from the length of the range, then filled with emplace
+    template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashTable(InputIt first, InputIt last, const Hash& hash = Hash(), const KeyEqual& keyEqual = KeyEqual()) : HashTable(0, hash, keyEqual) {
+        reserve(rangeLength(first, last));
+        for (; first != last; ++first) {
+            emplace(*first);
+        }
+    }
+    HashTable(const HashTable& table) : RehashLog(), hasher(table.hasher), equal(table.equal) {
+        allocate(table.length);
+        for (size_t i = 0; i < table.length; i++) {
+            if (table.keys[i] != empty()) {
+                new (&values[i].value) ValueType(table.values[i].value);
+                keys[i] = table.keys[i];
+            }
+        }
+        count = table.count;
+    }
+    HashTable& operator=(const HashTable& table) {
+        if (this != &table) {
+            HashTable copy(table);
+            swap(copy);
+        }
+        return *this;
+    }
+    ~HashTable() {
+        release();
+    }
+    void swap(HashTable& table) {
+        std::swap(hasher, table.hasher);
+        std::swap(equal, table.equal);
+        std::swap(keys, table.keys);
+        std::swap(values, table.values);
+        std::swap(length, table.length);
+        std::swap(count, table.count);
+        std::swap(shift, table.shift);
+    }
+    HashIterator insert(const KeyType& key, const ValueType& data) {
+        return tryEmplaceKey(key, data).first;
+    }
+    template <typename... Args>
+    HashIterator emplace(Args&&... args) {
+        std::pair<KeyType, ValueType> entry(std::forward<Args>(args)...);
+        return tryEmplaceKey(entry.first, std::move(entry.second)).first;
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+    template <typename M>
+    std::pair<HashIterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    HashIterator find(const KeyType& key) {
+        return HashIterator(keys, values, findPos(key, home(key)), length);
+    }
+    // Looks up keys[0..n) into out[0..n). Keys are hashed and their home
+    // slots prefetched a batch at a time, so the cache misses overlap.
+    void find_batch(const KeyType* batch, size_t n, HashIterator* out) {
+        size_t pos[tableBatchWidth];
+        for (size_t first = 0; first < n; first += tableBatchWidth) {
+            size_t m = std::min(tableBatchWidth, n - first);
+            for (size_t i = 0; i < m; i++) {
+                pos[i] = home(batch[first + i]);
+                tablePrefetch(&keys[pos[i]]);
+            }
+            for (size_t i = 0; i < m; i++) {
+                out[first + i] = HashIterator(keys, values, findPos(batch[first + i], pos[i]), length);
+            }
+        }
+    }
+    // Sets out[i] to whether keys[i] is present; returns how many are
+    size_t contains_batch(const KeyType* batch, size_t n, bool* out) {
+        return containsBatch(*this, batch, n, out);
+    }
+    bool remove(const KeyType& key) {
+        size_t pos = findPos(key, home(key));
+        if (pos == length) {
+            return false;
+        }
+        values[pos].value.~ValueType();
+        // backward shift: move later entries of the run into the hole unless
+        // their home lies after it
+        size_t mask = length - 1;
+        for (size_t next = (pos + 1) & mask; keys[next] != empty(); next = (next + 1) & mask) {
+            size_t h = home(keys[next]);
+            bool stays = pos <= next ? (pos < h && h <= next) : (pos < h || h <= next);
+            if (!stays) {
+                keys[pos] = keys[next];
+                new (&values[pos].value) ValueType(std::move(values[next].value));
+                values[next].value.~ValueType();
+                pos = next;
+            }
         }
-        return sum % length;
+        keys[pos] = empty();
+        count--;
+        return true;
     }
-    int hash(char c) {
-        char al[] = "abcdefghijklmnopqrstuvwxyz";
-        int sum = 0;
-        for (int j = 0; j < 26; j++) {
-            if (c == al[j]) {
-                sum += pow(j, i);
-            }
+    ValueType& operator[](const KeyType& key) {
+        size_t pos = findPos(key, home(key));
+        if (pos == length) {
+            throw std::runtime_error("Invalid key!");
         }
-        return sum % length;
+        return values[pos].value;
     }
-    int hash(long long i) {
-        return i % length;
+    size_t size() const {
+        return count;
     }
-    int hash(int i) {
-        return i % length;
+    float load_factor() const {
+        return static_cast<float>(count) / length;
     }
-    int hash(double i) {
-        i = abs(i);
-        int ptr;
-        int man = frexp(i, &ptr);
-        int ord = trunc(i);
-        int res = man + pow(2, ord);
-        return res % length;
+    size_t bucket_count() const {
+        return length;
     }
-    int hash(float i) {
-        i = abs(i);
-        int ptr;
-        int man = frexp(i, &ptr);
-        int ord = trunc(i);
-        int res = man + pow(2, ord);
-        return res % length;
+    // Rebuilds the arrays with at least the given number of slots (rounded up
+    // to a power of two), and never more than 3/4 full.
+    void rehash(size_t buckets) {
+        resize(std::max(buckets, slotsFor(count)));
     }
-    int hash(std::vector<int> v) {
-        int sum = 0;
-        for (int i = 0; i < v.size(); i++) {
-            sum += v[i];
+    // Makes room for n elements, so that inserting up to n does not resize
+    void reserve(size_t n) {
+        if (n * 4 > length * 3) {
+            resize(slotsFor(n));
         }
-        return sum % length;
     }
-    auto insert(KeyType key, const ValueType& data) {
-        int pos = hash(key);
-        array[pos].push_back(std::make_pair(key, data));
-        int cap = checkCollisions();
-        if (cap) {
-            *this = this->balanceCollisions(cap);
-        }
-        pos = hash(key);
-        for (auto it = array[pos].begin(); it != array[pos].end(); it++) {
-            if (it->first == key) {
-                return it;
+    void shrink_to_fit() {
+        rehash(0);
+    }
+    // Copies of the hash and equality policies
+    Hash hash_function() const {
+        return hasher;
+    }
+    KeyEqual key_eq() const {
+        return equal;
+    }
+    // Layout snapshot: probe lengths, empty buckets, memory and, with
+    // TABLE_STATS, rehash counts and times. Scans the whole table.
+    TableStats stats() const {
+        TableStats stats;
+        stats.size = count;
+        stats.buckets = bucket_count();
+        stats.loadFactor = load_factor();
+        for (size_t i = 0; i < length; i++) {
+            if (keys[i] != empty()) {
+                stats.countProbe(((i - home(keys[i])) & (length - 1)) + 1);
             }
         }
+        stats.emptyBucketRatio = static_cast<float>(length - count) / length;
+        stats.bytes = length * (sizeof(KeyType) + sizeof(ValueSlot));
+        fillRehashStats(stats);
+        return stats;
+    }
 
+    HashIterator begin() {
+        return HashIterator::begin(keys, values, length);
     }
-    HashIterator find(const KeyType& key) {
-        int pos = hash(key);
-        for (auto it = array[pos].begin(); it != array[pos].end(); it++) {
-            if (it->first == key) {
-                return HashIterator(array, pos, it - array[pos].begin(), length);
+    HashIterator end() {
+        return HashIterator(keys, values, length, length);
+    }
+    friend std::ostream& operator<<(std::ostream& out, const HashTable& table) {
+        for (size_t i = 0; i < table.length; i++) {
+            if (table.keys[i] != empty()) {
+                out << "slot: " << i << " " << "key: " << table.keys[i] << " " << "value: " << table.values[i].value << std::endl;
             }
         }
-        return HashIterator(array, length, 0, length);
+        return out;
     }
-    bool remove(const KeyType& key) {
-        int pos = hash(key);
-        for (auto it = array[pos].begin(); it != array[pos].end(); it++) {
-            if (it->first == key) {
-                array[pos].erase(it);
-                return true;
+private:
+    void allocate(size_t ptr) {
+        length = 8;
+        shift = 61;
+        while (length < ptr) {
+            length *= 2;
+            shift--;
+        }
+        keys = new KeyType[length];
+        std::fill(keys, keys + length, empty());
+        values = new ValueSlot[length];
+        count = 0;
+    }
+    void release() {
+        for (size_t i = 0; i < length; i++) {
+            if (keys[i] != empty()) {
+                values[i].value.~ValueType();
             }
         }
-        return false;
+        delete[] values;
+        delete[] keys;
     }
-    ValueType& operator[](const KeyType& key) {
-        int pos = hash(key);
-        for (auto it = array[pos].begin(); it != array[pos].end(); ++it) {
-            if (it->first == key) {
-                return it->second;
+    size_t home(const KeyType& key) const {
+        return (static_cast<uint64_t>(hasher(key)) * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+    // Slot of the key, or length; pos must be its home slot
+    size_t findPos(const KeyType& key, size_t pos) const {
+        if (key == empty()) {
+            return length;
+        }
+        size_t mask = length - 1;
+        for (; keys[pos] != empty(); pos = (pos + 1) & mask) {
+            if (equal(keys[pos], key)) {
+                return pos;
+            }
+        }
+        return length;
+    }
+    size_t freePos(const KeyType& key) const {
+        size_t mask = length - 1;
+        size_t pos = home(key);
+        while (keys[pos] != empty()) {
+            pos = (pos + 1) & mask;
+        }
+        return pos;
+    }
+    template <typename... Args>
+    std::pair<HashIterator, bool> tryEmplaceKey(const KeyType& key, Args&&... args) {
+        if (key == empty()) {
+            throw std::runtime_error("Reserved key!");
+        }
+        size_t pos = findPos(key, home(key));
+        if (pos != length) {
+            return std::make_pair(HashIterator(keys, values, pos, length), false);
+        }
+        if ((count + 1) * 4 > length * 3) {
+            resize(length * 2);
+        }
+        pos = freePos(key);
+        new (&values[pos].value) ValueType(std::forward<Args>(args)...);
+        keys[pos] = key;
+        count++;
+        return std::make_pair(HashIterator(keys, values, pos, length), true);
+    }
+    static size_t slotsFor(size_t n) {
+        return n + (n + 2) / 3;
+    }
+    void resize(size_t newLength) {
+        rehashStarted();
+        auto timer = rehashTimer();
+        HashTable table(static_cast<int>(newLength), hasher, equal);
+        for (size_t i = 0; i < length; i++) {
+            if (keys[i] != empty()) {
+                size_t pos = table.freePos(keys[i]);
+                new (&table.values[pos].value) ValueType(std::move(values[i].value));
+                table.keys[pos] = keys[i];
+                table.count++;
             }
         }
-        throw std::runtime_error("Invalid key!");
+        swap(table);
     }
+};
 
-    HashIterator begin() {
-        return HashIterator::begin(array, length);
+// Map for a handful of entries: up to N of them are kept inside the object
+// and found by a linear scan, with no allocation at all. Inserting key N + 1
+// moves everything into a heap-allocated Table, used from then on, even if
+// the map shrinks again.
+template <typename KeyType, typename ValueType, size_t N = 8,
+          typename Table = HashTable<KeyType, ValueType>, typename KeyEqual = TableKeyEqual<KeyType>>
+class SmallHashTable {
+private:
+    typedef std::pair<KeyType, ValueType> Entry;
+
+    SmallVector<Entry, N> small;
+    std::unique_ptr<Table> large;
+    KeyEqual equal;
+public:
+    SmallHashTable() {}
+    SmallHashTable(const SmallHashTable& other) : small(other.small), large(other.large ? new Table(*other.large) : nullptr), equal(other.equal) {}
+    SmallHashTable(SmallHashTable&& other) = default;
+    SmallHashTable& operator=(SmallHashTable other) {
+        swap(other);
+        return *this;
     }
-    HashIterator end() {
-        return HashIterator(array, length, 0, length);
+    void swap(SmallHashTable& other) {
+        std::swap(small, other.small);
+        std::swap(large, other.large);
+        std::swap(equal, other.equal);
     }
-    int checkCollisions() {
-        int sum = 0;
-        for (int i = 0; i < length; i++) {
-            sum += array[i].size();
+    // Whether the entries still live inside the object
+    bool isInline() const {
+        return large == nullptr;
+    }
+    size_t size() const {
+        return large ? large->size() : small.size();
+    }
+    // Inserts when the key is absent; false if it was already there
+    bool insert(const KeyType& key, const ValueType& value) {
+        return try_emplace(key, value);
+    }
+    template <typename... Args>
+    bool try_emplace(const KeyType& key, Args&&... args) {
+        if (large) {
+            return large->try_emplace(key, std::forward<Args>(args)...).second;
         }
-        if (sum > length) {
-            return sum;
+        if (findInline(key) != nullptr) {
+            return false;
         }
-        else {
-            return 0;
+        if (small.size() == N) {
+            spill();
+            return large->try_emplace(key, std::forward<Args>(args)...).second;
         }
+        small.emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        return true;
     }
-    HashTable balanceCollisions(int newLength) {
-        HashTable<KeyType, ValueType> table(newLength);
-        for (int i = 0; i < this->length; i++) {
-            for (auto it = this->array[i].begin(); it != this->array[i].end(); it++) {
-                table.insert(it->first, it->second);
+    // True when the key was inserted, false when its value was replaced
+    template <typename M>
+    bool insert_or_assign(const KeyType& key, M&& obj) {
+        ValueType* value = find(key);
+        if (value != nullptr) {
+            *value = std::forward<M>(obj);
+            return false;
+        }
+        return try_emplace(key, std::forward<M>(obj));
+    }
+    // nullptr when the key is absent
+    ValueType* find(const KeyType& key) {
+        if (large) {
+            auto it = large->find(key);
+            return it != large->end() ? &it->second : nullptr;
+        }
+        Entry* entry = findInline(key);
+        return entry != nullptr ? &entry->second : nullptr;
+    }
+    bool contains(const KeyType& key) {
+        return find(key) != nullptr;
+    }
+    ValueType& operator[](const KeyType& key) {
+        ValueType* value = find(key);
+        if (value == nullptr) {
+            throw std::runtime_error("Invalid key!");
+        }
+        return *value;
+    }
+    // False when the key was absent
+    bool remove(const KeyType& key) {
+        if (large) {
+            return large->remove(key);
+        }
+        Entry* entry = findInline(key);
+        if (entry == nullptr) {
+            return false;
+        }
+        // order does not matter: move the last entry into the hole
+        if (entry != &small.back()) {
+            *entry = std::move(small.back());
+        }
+        small.erase(small.end() - 1);
+        return true;
+    }
+    // Calls f(key, value) for each entry
+    template <typename F>
+    void forEach(F f) {
+        if (large) {
+            for (auto it = large->begin(); it != large->end(); ++it) {
+                f(it->first, it->second);
             }
+            return;
+        }
+        for (Entry& entry : small) {
+            f(entry.first, entry.second);
         }
-        return table;
     }
-    friend std::ostream& operator<<(std::ostream& out, const HashTable& table) {
-        for (int i = 0; i < table.length; i++) {
-            for (auto it = table.array[i].begin(); it != table.array[i].end(); it++) {
-                std::cout <<"string: " << i << " " << "key: " << it->first << " " << "value: " << it->second << std::endl;
+private:
+    Entry* findInline(const KeyType& key) {
+        for (Entry& entry : small) {
+            if (equal(entry.first, key)) {
+                return &entry;
             }
         }
-        return out;
+        return nullptr;
+    }
+    void spill() {
+        std::unique_ptr<Table> table(new Table(static_cast<int>(N * 2)));
+        for (Entry& entry : small) {
+            table->try_emplace(std::move(entry.first), std::move(entry.second));
+        }
+        small.clear();
+        large = std::move(table);
     }
 };
 
@@ -411,8 +3181,53 @@ public:
     ~BinaryTree() {}
 
     void insert(const KeyType& key, ValueType value) {
-        root = insertNode(root, key, value);
+        emplace(key, std::move(value));
+    }
+
+    // The node is built in place from the key and the value arguments
+    template <typename K, typename... Args>
+    BinaryTreeIterator<KeyType, ValueType> emplace(K&& key, Args&&... args) {
+        Node<KeyType, ValueType>* node = new Node<KeyType, ValueType>(std::piecewise_construct, std::forward<K>(key), std::forward<Args>(args)...);
+        root = insertNode(root, node);
         size++;
+        return BinaryTreeIterator<KeyType, ValueType>(node);
+    }
+
+    template <typename... Args>
+    std::pair<BinaryTreeIterator<KeyType, ValueType>, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<BinaryTreeIterator<KeyType, ValueType>, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<BinaryTreeIterator<KeyType, ValueType>, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->value = std::forward<M>(obj);
+        }
+        return result;
+    }
+
+    template <typename M>
+    std::pair<BinaryTreeIterator<KeyType, ValueType>, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->value = std::forward<M>(obj);
+        }
+        return result;
+    }
+
+    // The node holding the key, nullptr when it is absent
+    Node<KeyType, ValueType>* lookup(const KeyType& key) const {
+        Node<KeyType, ValueType>* node = root;
+        while (node != nullptr && node->key != key) {
+            node = key < node->key ? node->left : node->right;
+        }
+        return node;
     }
 
     int sizeTree() {
@@ -421,29 +3236,25 @@ public:
     }
 
     void remove(const KeyType& key) {
-        root = removeNode(root, key);
-        if (root != nullptr) root->parent = nullptr;
-        size--;
+        removeKey(key);
+    }
+
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    void remove(const K& key) {
+        removeKey(key);
     }
 
     void inorder() {
         inorderNode(root);
     }
 
-    BinaryTreeIterator<KeyType, ValueType> find(KeyType key) const {
-        Node<KeyType, ValueType>* node = root;
-        while (node->key != key) {
-            if (key <= node->key && node->left != NULL) {
-                node = node->left;
-            }
-            else if (key > node->key && node->right != NULL) {
-                node = node->right;
-            }
-            else {
-                throw "Invalid value";
-            }
-        }
-        return BinaryTreeIterator<KeyType, ValueType>(node);
+    BinaryTreeIterator<KeyType, ValueType> find(const KeyType& key) const {
+        return findKey(key);
+    }
+
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    BinaryTreeIterator<KeyType, ValueType> find(const K& key) const {
+        return findKey(key);
     }
 
     BinaryTreeIterator<KeyType, ValueType> begin() const {
@@ -470,22 +3281,27 @@ public:
         return current;
     }
 
-    Node<KeyType, ValueType>* insertNode(Node<KeyType, ValueType>* node, KeyType key, ValueType value) {
+    Node<KeyType, ValueType>* insertNode(Node<KeyType, ValueType>* node, const KeyType& key, const ValueType& value) {
+        return insertNode(node, new Node<KeyType, ValueType>(key, value));
+    }
+
+    Node<KeyType, ValueType>* insertNode(Node<KeyType, ValueType>* node, Node<KeyType, ValueType>* fresh) {
         if (node == nullptr) {
-            return new Node<KeyType, ValueType>(key, value);
+            return fresh;
         }
-        if (key <= node->key) {
-            node->left = insertNode(node->left, key, value);
+        if (fresh->key <= node->key) {
+            node->left = insertNode(node->left, fresh);
             node->left->parent = node;
         }
-        if (key > node->key) {
-            node->right = insertNode(node->right, key, value);
+        else {
+            node->right = insertNode(node->right, fresh);
             node->right->parent = node;
         }
         return node;
     }
 
-    Node<KeyType, ValueType>* removeNode(Node<KeyType, ValueType>* node, KeyType key) {
+    template <typename K>
+    Node<KeyType, ValueType>* removeNode(Node<KeyType, ValueType>* node, const K& key) {
         if (node == nullptr) {
             return node;
         }
@@ -513,7 +3329,7 @@ public:
             Node<KeyType, ValueType>* temp = minValueNode(node->right);
             node->key = temp->key;
             node->value = temp->value;
-            node->right = removeNode(node->right, temp->key);
+            node->right = removeNode(node->right, node->key);
             if (node->right != nullptr)
                 node->right->parent = node;
         }
@@ -532,6 +3348,39 @@ public:
         return this->root;
     }
 
+private:
+    template <typename K, typename... Args>
+    std::pair<BinaryTreeIterator<KeyType, ValueType>, bool> tryEmplaceKey(K&& key, Args&&... args) {
+        Node<KeyType, ValueType>* node = lookup(key);
+        if (node != nullptr) {
+            return std::make_pair(BinaryTreeIterator<KeyType, ValueType>(node), false);
+        }
+        return std::make_pair(emplace(std::forward<K>(key), std::forward<Args>(args)...), true);
+    }
+
+    template <typename K>
+    void removeKey(const K& key) {
+        root = removeNode(root, key);
+        if (root != nullptr) root->parent = nullptr;
+        size--;
+    }
+
+    template <typename K>
+    BinaryTreeIterator<KeyType, ValueType> findKey(const K& key) const {
+        Node<KeyType, ValueType>* node = root;
+        while (node->key != key) {
+            if (key <= node->key && node->left != NULL) {
+                node = node->left;
+            }
+            else if (key > node->key && node->right != NULL) {
+                node = node->right;
+            }
+            else {
+                throw "Invalid value";
+            }
+        }
+        return BinaryTreeIterator<KeyType, ValueType>(node);
+    }
 };
 
 template <typename KeyType, typename ValueType>
@@ -545,8 +3394,53 @@ public:
     ~AVLTree() {}
 
     void insert(const KeyType& key, ValueType value) {
-        root = insertNode(root, key, value);
+        emplace(key, std::move(value));
+    }
+
+    // The node is built in place from the key and the value arguments
+    template <typename K, typename... Args>
+    AVLTreeIterator<KeyType, ValueType> emplace(K&& key, Args&&... args) {
+        NodeAVL<KeyType, ValueType>* node = new NodeAVL<KeyType, ValueType>(std::piecewise_construct, std::forward<K>(key), std::forward<Args>(args)...);
+        root = insertNode(root, node);
         size++;
+        return AVLTreeIterator<KeyType, ValueType>(node);
+    }
+
+    template <typename... Args>
+    std::pair<AVLTreeIterator<KeyType, ValueType>, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<AVLTreeIterator<KeyType, ValueType>, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<AVLTreeIterator<KeyType, ValueType>, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->value = std::forward<M>(obj);
+        }
+        return result;
+    }
+
+    template <typename M>
+    std::pair<AVLTreeIterator<KeyType, ValueType>, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->value = std::forward<M>(obj);
+        }
+        return result;
+    }
+
+    // The node holding the key, nullptr when it is absent
+    NodeAVL<KeyType, ValueType>* lookup(const KeyType& key) const {
+        NodeAVL<KeyType, ValueType>* node = root;
+        while (node != nullptr && node->key != key) {
+            node = key < node->key ? node->left : node->right;
+        }
+        return node;
     }
 
     int sizeTree() {
@@ -555,24 +3449,21 @@ public:
     }
 
     void remove(const KeyType& key) {
-        removeNode(root, key);
-        size--;
+        removeKey(key);
     }
 
-    AVLTreeIterator<KeyType, ValueType> find(KeyType key) const {
-        NodeAVL<KeyType, ValueType>* node = root;
-        while (node->key != key) {
-            if (key <= node->key && node->left != nullptr) {
-                node = node->left;
-            }
-            else if (key > node->key && node->right != nullptr) {
-                node = node->right;
-            }
-            else {
-                throw "Invalid value";
-            }
-        }
-        return AVLTreeIterator<KeyType, ValueType>(node);
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    void remove(const K& key) {
+        removeKey(key);
+    }
+
+    AVLTreeIterator<KeyType, ValueType> find(const KeyType& key) const {
+        return findKey(key);
+    }
+
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    AVLTreeIterator<KeyType, ValueType> find(const K& key) const {
+        return findKey(key);
     }
 
     AVLTreeIterator<KeyType, ValueType> begin() const {
@@ -634,23 +3525,28 @@ public:
         return node;
     }
 
-    NodeAVL<KeyType, ValueType>* insertNode(NodeAVL<KeyType, ValueType>* node, KeyType key, ValueType value) {
+    NodeAVL<KeyType, ValueType>* insertNode(NodeAVL<KeyType, ValueType>* node, const KeyType& key, const ValueType& value) {
+        return insertNode(node, new NodeAVL<KeyType, ValueType>(key, value));
+    }
+
+    NodeAVL<KeyType, ValueType>* insertNode(NodeAVL<KeyType, ValueType>* node, NodeAVL<KeyType, ValueType>* fresh) {
         if (node == nullptr) {
-            return new NodeAVL<KeyType, ValueType>(key, value);
+            return fresh;
         }
-        if (key <= node->key) {
-            node->left = insertNode(node->left, key, value);
+        if (fresh->key <= node->key) {
+            node->left = insertNode(node->left, fresh);
             node->left->parent = node;
         }
-        if (key > node->key) {
-            node->right = insertNode(node->right, key, value);
+        else {
+            node->right = insertNode(node->right, fresh);
             node->right->parent = node;
         }
         node->height = 1 + std::max(getHeight(node->left), getHeight(node->right));
         return balance(node);
     }
 
-    void removeNode(NodeAVL<KeyType, ValueType>*& node, const KeyType& key) {
+    template <typename K>
+    void removeNode(NodeAVL<KeyType, ValueType>*& node, const K& key) {
         if (node == nullptr) {
             return;
         }
@@ -687,7 +3583,7 @@ public:
                 NodeAVL<KeyType, ValueType>* temp = minValueNode(node->right);
                 node->key = temp->key;
                 node->value = temp->value;
-                return removeNode(node->right, temp->key);
+                return removeNode(node->right, node->key);
             }
         }
     }
@@ -754,6 +3650,39 @@ public:
         node = leftRotate(y);
         return rightRotate(node);
     }
+
+private:
+    template <typename K, typename... Args>
+    std::pair<AVLTreeIterator<KeyType, ValueType>, bool> tryEmplaceKey(K&& key, Args&&... args) {
+        NodeAVL<KeyType, ValueType>* node = lookup(key);
+        if (node != nullptr) {
+            return std::make_pair(AVLTreeIterator<KeyType, ValueType>(node), false);
+        }
+        return std::make_pair(emplace(std::forward<K>(key), std::forward<Args>(args)...), true);
+    }
+
+    template <typename K>
+    void removeKey(const K& key) {
+        removeNode(root, key);
+        size--;
+    }
+
+    template <typename K>
+    AVLTreeIterator<KeyType, ValueType> findKey(const K& key) const {
+        NodeAVL<KeyType, ValueType>* node = root;
+        while (node->key != key) {
+            if (key <= node->key && node->left != nullptr) {
+                node = node->left;
+            }
+            else if (key > node->key && node->right != nullptr) {
+                node = node->right;
+            }
+            else {
+                throw "Invalid value";
+            }
+        }
+        return AVLTreeIterator<KeyType, ValueType>(node);
+    }
 };
 
 template <typename KeyType, typename ValueType>
@@ -769,31 +3698,81 @@ public:
     }
 
     void insert(const KeyType& key, ValueType value) {
-        NodeRB<KeyType, ValueType>* node = new NodeRB<KeyType, ValueType>(key, value);
+        emplace(key, std::move(value));
+    }
+
+    // The node is built in place from the key and the value arguments
+    template <typename K, typename... Args>
+    RBTreeIterator<KeyType, ValueType> emplace(K&& key, Args&&... args) {
+        NodeRB<KeyType, ValueType>* node = new NodeRB<KeyType, ValueType>(std::piecewise_construct, std::forward<K>(key), std::forward<Args>(args)...);
+        NodeRB<KeyType, ValueType>* existing = lookup(node->key);
+        if (existing != nullptr) {
+            delete node; // keys are unique in this tree
+            return RBTreeIterator<KeyType, ValueType>(existing);
+        }
         root = insertNode(root, node);
         root->is_red = false; // root is always black
         size++;
+        return RBTreeIterator<KeyType, ValueType>(node);
     }
 
-    int sizeTree() {
-        return size;
+    template <typename... Args>
+    std::pair<RBTreeIterator<KeyType, ValueType>, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplaceKey(key, std::forward<Args>(args)...);
     }
 
-    void remove(const KeyType& key) {
-        root = removeNode(root, key);
-        if (root != nullptr) root->is_red = false; // root is always black
-        size--;
+    template <typename... Args>
+    std::pair<RBTreeIterator<KeyType, ValueType>, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<RBTreeIterator<KeyType, ValueType>, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = tryEmplaceKey(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->value = std::forward<M>(obj);
+        }
+        return result;
+    }
+
+    template <typename M>
+    std::pair<RBTreeIterator<KeyType, ValueType>, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = tryEmplaceKey(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->value = std::forward<M>(obj);
+        }
+        return result;
     }
 
-    RBTreeIterator<KeyType, ValueType> find(KeyType key) const {
+    // The node holding the key, nullptr when it is absent
+    NodeRB<KeyType, ValueType>* lookup(const KeyType& key) const {
         NodeRB<KeyType, ValueType>* node = root;
         while (node != nullptr && node->key != key) {
-            if (key < node->key)
-                node = node->left;
-            else
-                node = node->right;
+            node = key < node->key ? node->left : node->right;
         }
-        return RBTreeIterator<KeyType, ValueType>(node);
+        return node;
+    }
+
+    int sizeTree() {
+        return size;
+    }
+
+    void remove(const KeyType& key) {
+        removeKey(key);
+    }
+
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    void remove(const K& key) {
+        removeKey(key);
+    }
+
+    RBTreeIterator<KeyType, ValueType> find(const KeyType& key) const {
+        return findKey(key);
+    }
+
+    template <typename K, typename = typename std::enable_if<TransparentKey<KeyType, K>::value>::type>
+    RBTreeIterator<KeyType, ValueType> find(const K& key) const {
+        return findKey(key);
     }
 
     NodeRB<KeyType, ValueType>* operator->() {
@@ -817,6 +3796,34 @@ public:
     }
 
 private:
+    template <typename K, typename... Args>
+    std::pair<RBTreeIterator<KeyType, ValueType>, bool> tryEmplaceKey(K&& key, Args&&... args) {
+        NodeRB<KeyType, ValueType>* node = lookup(key);
+        if (node != nullptr) {
+            return std::make_pair(RBTreeIterator<KeyType, ValueType>(node), false);
+        }
+        return std::make_pair(emplace(std::forward<K>(key), std::forward<Args>(args)...), true);
+    }
+
+    template <typename K>
+    void removeKey(const K& key) {
+        root = removeNode(root, key);
+        if (root != nullptr) root->is_red = false; // root is always black
+        size--;
+    }
+
+    template <typename K>
+    RBTreeIterator<KeyType, ValueType> findKey(const K& key) const {
+        NodeRB<KeyType, ValueType>* node = root;
+        while (node != nullptr && node->key != key) {
+            if (key < node->key)
+                node = node->left;
+            else
+                node = node->right;
+        }
+        return RBTreeIterator<KeyType, ValueType>(node);
+    }
+
     NodeRB<KeyType, ValueType>* insertNode(NodeRB<KeyType, ValueType>* root, NodeRB<KeyType, ValueType>* node) {
         if (root == nullptr)
             return node;
@@ -842,7 +3849,8 @@ private:
         return root;
     }
 
-    NodeRB<KeyType, ValueType>* removeNode(NodeRB<KeyType, ValueType>* root, const KeyType& key) {
+    template <typename K>
+    NodeRB<KeyType, ValueType>* removeNode(NodeRB<KeyType, ValueType>* root, const K& key) {
         if (root == nullptr)
             return nullptr;
 
@@ -867,7 +3875,7 @@ private:
             NodeRB<KeyType, ValueType>* temp = minValueNode(root->right);
             root->key = temp->key;
             root->value = temp->value;
-            root->right = removeNode(root->right, temp->key);
+            root->right = removeNode(root->right, root->key);
         }
 
         if (isRed(root->right) && !isRed(root->left))
@@ -1,8 +1,17 @@
 #include "gtest.h"
 #include <table.hpp>
+#include <concurrent.hpp>
+#include <filter.hpp>
+#include <frozen.hpp>
+#include <string_arena.hpp>
+#include <cache.hpp>
+#include <map>
 #include <random>
+#include <sstream>
 #include <chrono>
 #include <numeric>
+#include <string_view>
+#include <thread>
 
 TEST(SimpleTable, can_insert_items_in_table)
 {
@@ -119,6 +128,89 @@ TEST(SortTable, can_find_in_even_table) {
     EXPECT_EQ(table.find(2).getPtr()->second, 3);
 }
 
+TEST(SortTable, can_find_by_string_view) {
+	SortTable<std::string, int> table;
+	table.insert("gold", 1);
+	table.insert("silver", 2);
+	table.insert("platinum", 3);
+	std::string_view key("silver");
+	EXPECT_EQ(table.find(key).getPtr()->second, 2);
+	EXPECT_EQ(table["gold"], 1);
+	table.remove(std::string_view("gold"));
+	EXPECT_EQ(table.getSize(), 2);
+}
+
+TEST(SimpleTable, try_emplace_keeps_existing_value) {
+	SimpleTable<std::string, std::string> table;
+	std::string key("gold"), value(100, 'x');
+	EXPECT_TRUE(table.try_emplace(std::move(key), std::move(value)).second);
+	EXPECT_TRUE(value.empty());
+	std::string other("silver");
+	auto result = table.try_emplace("gold", std::move(other));
+	EXPECT_FALSE(result.second);
+	EXPECT_EQ(other, "silver");
+	EXPECT_EQ(result.first.getPtr()->second, std::string(100, 'x'));
+	EXPECT_FALSE(table.insert_or_assign("gold", "copper").second);
+	EXPECT_EQ(table["gold"], "copper");
+	EXPECT_EQ(table.getSize(), 1);
+}
+
+TEST(SimpleTable, inline_storage_keeps_entries_past_its_capacity) {
+	SimpleTable<int, std::string, 4> table;
+	for (int i = 0; i < 10; i++)
+		table.try_emplace(i, std::to_string(i));
+	table.remove(2);
+	SimpleTable<int, std::string, 4> copy(table);
+	EXPECT_EQ(copy.getSize(), 9);
+	for (int i = 0; i < 10; i++)
+	{
+		if (i != 2)
+		{
+			EXPECT_EQ(copy[i], std::to_string(i));
+		}
+	}
+	EXPECT_EQ(findValue(copy, 2), nullptr);
+}
+
+TEST(SmallHashTable, stays_inline_until_it_overflows) {
+	SmallHashTable<std::string, int, 4> table;
+	for (int i = 0; i < 4; i++)
+		EXPECT_TRUE(table.insert(std::to_string(i), i));
+	EXPECT_FALSE(table.insert("0", 5));
+	EXPECT_TRUE(table.isInline());
+	EXPECT_TRUE(table.remove("1"));
+	EXPECT_FALSE(table.remove("1"));
+	EXPECT_TRUE(table.insert_or_assign("1", 10));
+	EXPECT_TRUE(table.isInline());
+	EXPECT_TRUE(table.insert("4", 4));
+	EXPECT_FALSE(table.isInline());
+	SmallHashTable<std::string, int, 4> copy(table);
+	EXPECT_EQ(copy.size(), 5);
+	EXPECT_EQ(copy["0"], 0);
+	EXPECT_EQ(copy["1"], 10);
+	EXPECT_EQ(copy["4"], 4);
+	EXPECT_EQ(copy.find("5"), nullptr);
+	EXPECT_THROW(copy["5"], std::runtime_error);
+	int sum = 0;
+	forEachEntry(copy, [&](const std::string&, int value) { sum += value; });
+	EXPECT_EQ(sum, 0 + 10 + 2 + 3 + 4);
+}
+
+TEST(SortTable, can_emplace_in_order) {
+	SortTable<int, std::string> table;
+	table.emplace(3, "c");
+	table.emplace(1, "a");
+	EXPECT_TRUE(table.try_emplace(2, 3, 'b').second);
+	EXPECT_FALSE(table.try_emplace(2, "x").second);
+	EXPECT_TRUE(table.insert_or_assign(4, "d").second);
+	EXPECT_FALSE(table.insert_or_assign(1, "z").second);
+	EXPECT_EQ(table.getSize(), 4);
+	EXPECT_EQ(table.find(2).getPtr()->second, "bbb");
+	EXPECT_EQ(table.find(1).getPtr()->second, "z");
+	EXPECT_EQ(table.begin().getPtr()->first, 1);
+	EXPECT_EQ((table.begin() + 3).getPtr()->first, 4);
+}
+
 TEST(HashTable, can_create_hash_table) {
     HashTable<int, int> table(100);
 }
@@ -217,12 +309,12 @@ TEST(HashTable, can_balance) {
 	}
 }
 
-/*TEST(HashTable, can_balance_big_table) {
+TEST(HashTable, can_balance_big_table) {
 	HashTable<int, int> ht(10);
 	for (int i = 0; i < 1000; i++) {
 		ht.insert(i, i);
 	}
-}*/
+}
 
 TEST(HashTable, can_solve_collisions) {
 	HashTable<int, int> table(10);
@@ -231,6 +323,1214 @@ TEST(HashTable, can_solve_collisions) {
 	}
 }
 
+TEST(HashTable, can_get_size) {
+	HashTable<int, int> table(10);
+	for (int i = 0; i < 100; i++) {
+		table.insert(i, i);
+	}
+	table.remove(5);
+	table.remove(500);
+	EXPECT_EQ(table.size(), 99);
+}
+
+TEST(HashTable, keeps_load_factor_under_max) {
+	HashTable<int, int> table(1);
+	table.max_load_factor(2.0f);
+	for (int i = 0; i < 100000; i++) {
+		table.insert(i, i);
+		ASSERT_LE(table.load_factor(), 2.0f);
+	}
+	EXPECT_GT(table.load_factor(), 0.5f);
+	EXPECT_ANY_THROW(table.max_load_factor(0.0f));
+}
+
+TEST(HashTable, can_rehash_incrementally) {
+	HashTable<int, int> table(10);
+	table.setRehashStep(1);
+	bool rehashing = false;
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i, i);
+		rehashing = rehashing || table.isRehashing();
+		EXPECT_EQ(table[i / 2], i / 2);
+	}
+	EXPECT_TRUE(rehashing);
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_EQ(table.find(i)->second, i);
+	}
+}
+
+TEST(HashTable, can_remove_while_rehashing) {
+	HashTable<int, int> table(4);
+	table.setRehashStep(1);
+	for (int i = 0; i < 100; i++) {
+		table.insert(i, i);
+	}
+	for (int i = 0; i < 100; i += 2) {
+		EXPECT_TRUE(table.remove(i));
+	}
+	int n = 0;
+	for (auto it = table.begin(); it != table.end(); ++it) {
+		EXPECT_EQ(it->first % 2, 1);
+		n++;
+	}
+	EXPECT_FALSE(table.isRehashing());
+	EXPECT_EQ(n, 50);
+}
+
+TEST(HashTable, iterator_from_find_reaches_end_while_rehashing) {
+	HashTable<int, int> table(4);
+	table.setRehashStep(1);
+	for (int i = 0; i < 5; i++) {
+		table.insert(i, i);
+	}
+	ASSERT_TRUE(table.isRehashing());
+	for (int key = 0; key < 5; key++) {
+		size_t steps = 0;
+		for (auto it = table.find(key); it != table.end() && steps <= table.size(); ++it) {
+			steps++;
+		}
+		EXPECT_GE(steps, 1u);
+		EXPECT_LE(steps, table.size());
+	}
+	std::ostringstream text;
+	text << table;
+	for (int i = 0; i < 5; i++) {
+		EXPECT_NE(text.str().find("key: " + std::to_string(i) + " "), std::string::npos);
+	}
+}
+
+TEST(HashTable, can_copy_while_rehashing) {
+	HashTable<int, int> table(4);
+	table.setRehashStep(1);
+	for (int i = 0; i < 20; i++) {
+		table.insert(i, i);
+	}
+	HashTable<int, int> copy(table);
+	for (int i = 0; i < 20; i++) {
+		EXPECT_EQ(copy[i], i);
+	}
+}
+
+TEST(HashTable, hash_spreads_patterned_keys) {
+	HashTable<int, int> table(64);
+	std::vector<bool> used(64, false);
+	int buckets = 0;
+	for (int i = 0; i < 64; i++) {
+		int pos = table.bucket(i * 64, 64);
+		buckets += !used[pos];
+		used[pos] = true;
+	}
+	EXPECT_GT(buckets, 32);
+}
+
+TEST(HashTable, default_hashes_distinguish_keys) {
+	TableHash<std::vector<int>> vectorHash;
+	EXPECT_NE(vectorHash(std::vector<int>{ 1, 2 }), vectorHash(std::vector<int>{ 2, 1 }));
+	TableHash<std::string> stringHash;
+	EXPECT_NE(stringHash("ab"), stringHash("ba"));
+	EXPECT_NE(stringHash(std::string(40, 'a')), stringHash(std::string(41, 'a')));
+	TableHash<double> doubleHash;
+	EXPECT_EQ(doubleHash(0.0), doubleHash(-0.0));
+	EXPECT_NE(doubleHash(1.0), doubleHash(2.0));
+	TableHash<long double> longDoubleHash;
+	EXPECT_EQ(longDoubleHash(0.0L), longDoubleHash(-0.0L));
+	EXPECT_NE(longDoubleHash(1.0L), longDoubleHash(2.0L));
+	EXPECT_NE(longDoubleHash(1.0L), longDoubleHash(4.0L));
+	EXPECT_NE(longDoubleHash(2.0L), longDoubleHash(4.0L));
+}
+
+struct CaseInsensitiveHash {
+	size_t operator()(const std::string& s) const {
+		std::string lower(s);
+		std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+		return TableHash<std::string>()(lower);
+	}
+};
+
+struct CaseInsensitiveEqual {
+	bool operator()(const std::string& a, const std::string& b) const {
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return tolower(x) == tolower(y); });
+	}
+};
+
+template <typename Probing>
+void checkCustomPolicies() {
+	HashTable<std::string, int, Probing, CaseInsensitiveHash, CaseInsensitiveEqual> table(4);
+	table.insert("Gold", 1);
+	table.insert("Silver", 2);
+	EXPECT_EQ(table["GOLD"], 1);
+	EXPECT_EQ(table.find("silver")->second, 2);
+	EXPECT_TRUE(table.remove("gOLD"));
+	EXPECT_TRUE(table.find("Gold") == table.end());
+}
+
+TEST(HashTable, can_use_custom_hash_and_key_equal) {
+	checkCustomPolicies<Chaining>();
+	checkCustomPolicies<StableChaining>();
+	checkCustomPolicies<RobinHood>();
+	checkCustomPolicies<GroupProbing>();
+	checkCustomPolicies<Cuckoo>();
+}
+
+template <typename Probing>
+void checkStringViewLookup() {
+	HashTable<std::string, int, Probing> table(4);
+	table.insert("gold", 1);
+	table.insert("silver", 2);
+	const char buffer[] = "gold,silver";
+	std::string_view gold(buffer, 4), silver(buffer + 5, 6);
+	EXPECT_EQ(table.find(gold)->second, 1);
+	EXPECT_EQ(table[silver], 2);
+	EXPECT_TRUE(table.find(std::string_view(buffer)) == table.end());
+	EXPECT_TRUE(table.remove(gold));
+	EXPECT_TRUE(table.find("gold") == table.end());
+}
+
+TEST(HashTable, can_find_by_string_view) {
+	checkStringViewLookup<Chaining>();
+	checkStringViewLookup<StableChaining>();
+	checkStringViewLookup<RobinHood>();
+	checkStringViewLookup<GroupProbing>();
+	checkStringViewLookup<Cuckoo>();
+}
+
+template <typename Probing>
+void checkEmplace() {
+	HashTable<int, std::unique_ptr<int>, Probing> table(4);
+	for (int i = 0; i < 100; i++) {
+		EXPECT_TRUE(table.try_emplace(i, new int(i)).second);
+	}
+	std::unique_ptr<int> other(new int(-1));
+	EXPECT_FALSE(table.try_emplace(7, std::move(other)).second);
+	EXPECT_TRUE(other != nullptr);
+	EXPECT_FALSE(table.insert_or_assign(7, std::move(other)).second);
+	EXPECT_TRUE(other == nullptr);
+	EXPECT_EQ(*table.find(7)->second, -1);
+	EXPECT_EQ(*table.emplace(100, std::unique_ptr<int>(new int(100)))->second, 100);
+	EXPECT_EQ(table.size(), 101);
+	for (int i = 0; i < 100; i++) {
+		EXPECT_EQ(*table.find(i)->second, i == 7 ? -1 : i);
+	}
+}
+
+TEST(HashTable, can_emplace_move_only_values) {
+	checkEmplace<Chaining>();
+	checkEmplace<StableChaining>();
+	checkEmplace<RobinHood>();
+	checkEmplace<GroupProbing>();
+	checkEmplace<Cuckoo>();
+	checkEmplace<Flat>();
+}
+
+template <typename Probing>
+void checkSizing() {
+	HashTable<int, int, Probing> table(1);
+	table.reserve(1000);
+	size_t buckets = table.bucket_count();
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i, i);
+	}
+	EXPECT_EQ(table.bucket_count(), buckets);
+	for (int i = 0; i < 900; i++) {
+		table.remove(i);
+	}
+	table.shrink_to_fit();
+	EXPECT_LT(table.bucket_count(), buckets);
+	table.rehash(4096);
+	EXPECT_GE(table.bucket_count(), 4096u);
+	EXPECT_EQ(table.size(), 100);
+	for (int i = 900; i < 1000; i++) {
+		EXPECT_EQ(table.find(i)->second, i);
+	}
+}
+
+TEST(HashTable, can_reserve_rehash_and_shrink) {
+	checkSizing<Chaining>();
+	checkSizing<StableChaining>();
+	checkSizing<RobinHood>();
+	checkSizing<GroupProbing>();
+	checkSizing<Cuckoo>();
+	checkSizing<Flat>();
+}
+
+template <typename Probing>
+void checkRangeConstructor() {
+	std::vector<std::pair<int, int>> items;
+	for (int i = 0; i < 500; i++) {
+		items.emplace_back(i, i * 3);
+	}
+	HashTable<int, int, Probing> table(items.begin(), items.end());
+	EXPECT_EQ(table.size(), 500);
+	EXPECT_GE(table.bucket_count(), 500u);
+	for (int i = 0; i < 500; i++) {
+		EXPECT_EQ(table.find(i)->second, i * 3);
+	}
+}
+
+TEST(HashTable, can_build_from_range) {
+	checkRangeConstructor<Chaining>();
+	checkRangeConstructor<StableChaining>();
+	checkRangeConstructor<RobinHood>();
+	checkRangeConstructor<GroupProbing>();
+	checkRangeConstructor<Cuckoo>();
+	checkRangeConstructor<Flat>();
+}
+
+// 50 keys get 50 buckets, so every key lands in bucket 0
+struct FiftyHash {
+	size_t operator()(int key) const {
+		return static_cast<size_t>(key) * 50;
+	}
+};
+
+TEST(HashTable, range_build_packs_chains_and_keeps_them_searchable) {
+	std::vector<std::pair<int, int>> items;
+	for (int i = 0; i < 5000; i++) {
+		items.emplace_back(i, i);
+	}
+	items.emplace_back(7, 70);
+	HashTable<int, int> built(items.begin(), items.end());
+	HashTable<int, int> inserted(0);
+	for (size_t i = 0; i < items.size(); i++) {
+		inserted.emplace(items[i]);
+	}
+	EXPECT_EQ(built.size(), items.size());
+	EXPECT_LT(built.stats().bytes, inserted.stats().bytes);
+	int sevens = 0;
+	for (auto it = built.begin(); it != built.end(); ++it) {
+		sevens += it->first == 7;
+	}
+	EXPECT_EQ(sevens, 2);
+	for (int i = 0; i < 5000; i++) {
+		EXPECT_TRUE(built.find(i) != built.end());
+	}
+	// every key in one bucket: the chain must come out sorted
+	std::vector<std::pair<int, int>> piled;
+	for (int i = 0; i < 50; i++) {
+		piled.emplace_back(i, i);
+	}
+	HashTable<int, int, Chaining, FiftyHash> pile(piled.begin(), piled.end());
+	EXPECT_EQ(pile.stats().emptyBucketRatio, 49.0f / 50);
+	for (int i = 0; i < 50; i++) {
+		EXPECT_EQ(pile[i], i);
+	}
+}
+
+template <typename Probing>
+void checkBatchLookup() {
+	HashTable<int, int, Probing> table(4);
+	for (int i = 0; i < 1000; i += 2) {
+		table.insert(i, i * 2);
+	}
+	std::vector<int> keys(100);
+	std::iota(keys.begin(), keys.end(), 450);
+	std::vector<typename HashTable<int, int, Probing>::HashIterator> found(keys.size(), table.end());
+	table.find_batch(keys.data(), keys.size(), found.data());
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (keys[i] % 2 == 0 && keys[i] < 1000) {
+			EXPECT_EQ(found[i]->second, keys[i] * 2);
+		}
+		else {
+			EXPECT_TRUE(found[i] == table.end());
+		}
+	}
+	bool present[100];
+	EXPECT_EQ(table.contains_batch(keys.data(), keys.size(), present), 50u);
+	for (size_t i = 0; i < keys.size(); i++) {
+		EXPECT_EQ(present[i], keys[i] % 2 == 0 && keys[i] < 1000);
+	}
+}
+
+// A batch found in the middle of an incremental rehash must stay valid
+// until the next operation on the table
+template <typename Probing>
+void checkBatchLookupWhileRehashing() {
+	HashTable<int, int, Probing> table(64);
+	table.setRehashStep(1);
+	size_t buckets = table.bucket_count();
+	int n = 0;
+	while (table.bucket_count() == buckets) {
+		table.insert(n, n * 2);
+		n++;
+	}
+	ASSERT_TRUE(table.isRehashing());
+	std::vector<int> keys(n + 10);
+	std::iota(keys.begin(), keys.end(), 0);
+	std::vector<typename HashTable<int, int, Probing>::HashIterator> found(keys.size(), table.end());
+	table.find_batch(keys.data(), keys.size(), found.data());
+	EXPECT_TRUE(table.isRehashing());
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (keys[i] < n) {
+			ASSERT_TRUE(found[i] != table.end());
+			EXPECT_EQ(found[i]->first, keys[i]);
+			EXPECT_EQ(found[i]->second, keys[i] * 2);
+		}
+		else {
+			EXPECT_TRUE(found[i] == table.end());
+		}
+	}
+}
+
+TEST(HashTable, can_find_keys_in_batches) {
+	checkBatchLookup<Chaining>();
+	checkBatchLookup<StableChaining>();
+	checkBatchLookupWhileRehashing<Chaining>();
+	checkBatchLookupWhileRehashing<StableChaining>();
+	checkBatchLookup<RobinHood>();
+	checkBatchLookup<GroupProbing>();
+	checkBatchLookup<Cuckoo>();
+	checkBatchLookup<Flat>();
+}
+
+template <typename Probing>
+void checkStats() {
+	HashTable<int, int, Probing> table(4);
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i, i);
+	}
+	TableStats stats = table.stats();
+	EXPECT_EQ(stats.size, 1000u);
+	EXPECT_EQ(stats.buckets, table.bucket_count());
+	EXPECT_EQ(std::accumulate(stats.probeLengths.begin(), stats.probeLengths.end(), size_t(0)), 1000u);
+	EXPECT_GT(stats.probeLengths[0], 0u);
+	EXPECT_GE(stats.meanProbeLength(), 1.0);
+	EXPECT_GE(stats.emptyBucketRatio, 0.0f);
+	EXPECT_LT(stats.emptyBucketRatio, 1.0f);
+#ifdef TABLE_STATS
+	EXPECT_GT(stats.rehashCount, 0u);
+	EXPECT_LE(stats.maxRehashSeconds, stats.rehashSeconds);
+#else
+	// compiled out: nothing is counted and the engines carry no log
+	static_assert(std::is_empty<RehashLog>::value, "RehashLog must cost nothing without TABLE_STATS");
+	EXPECT_EQ(stats.rehashCount, 0u);
+	EXPECT_EQ(stats.rehashSeconds, 0.0);
+#endif
+	EXPECT_GE(stats.bytesPerEntry(), 8.0);
+	std::ostringstream text;
+	text << stats;
+	EXPECT_NE(text.str().find("probe lengths: 1: "), std::string::npos);
+}
+
+TEST(HashTable, reports_layout_stats) {
+	checkStats<Chaining>();
+	checkStats<StableChaining>();
+	checkStats<RobinHood>();
+	checkStats<GroupProbing>();
+	checkStats<Cuckoo>();
+	checkStats<Flat>();
+}
+
+TEST(HashTable, stats_show_one_long_chain) {
+	HashTable<int, int> table(1);
+	table.max_load_factor(100.0f);
+	for (int i = 0; i < 8; i++) {
+		table.insert(i, i);
+	}
+	TableStats stats = table.stats();
+	EXPECT_EQ(stats.probeLengths.size(), 8u);
+	EXPECT_EQ(stats.emptyBucketRatio, 0.0f);
+	EXPECT_EQ(stats.rehashCount, 0u);
+	EXPECT_DOUBLE_EQ(stats.meanProbeLength(), 4.5);
+	// a sorted chain is binary searched: 50 entries take up to 6 probes
+	for (int i = 8; i < 50; i++) {
+		table.insert(i, i);
+	}
+	stats = table.stats();
+	EXPECT_EQ(stats.probeLengths.size(), 6u);
+	EXPECT_EQ(stats.probeLengths[5], 50u);
+}
+
+TEST(HashTable, rehash_reuses_chain_memory) {
+	HashTable<int, int> table(16);
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i, i);
+	}
+	table.rehash(16);
+	table.rehash(4096);
+	size_t bytes = table.stats().bytes;
+	for (int i = 0; i < 10; i++) {
+		table.rehash(16);
+		table.rehash(4096);
+	}
+	EXPECT_EQ(table.stats().bytes, bytes);
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_EQ(table[i], i);
+	}
+}
+
+// Sends every key to bucket 0 while the table has at most 1024 buckets
+struct PileHash {
+	size_t operator()(int key) const {
+		return static_cast<size_t>(key) * 1024;
+	}
+};
+
+TEST(HashTable, long_chains_are_kept_searchable) {
+	HashTable<int, int, Chaining, PileHash> table(4);
+	table.max_load_factor(1000.0f);
+	for (int i = 0; i < 2000; i++) {
+		table.insert(i, i);
+	}
+	EXPECT_FALSE(table.try_emplace(5, 0).second);
+	for (int i = 0; i < 2000; i += 2) {
+		EXPECT_TRUE(table.remove(i));
+	}
+	for (int i = 0; i < 2000; i++) {
+		if (i % 2) {
+			ASSERT_EQ(table[i], i);
+		}
+		else {
+			ASSERT_TRUE(table.find(i) == table.end());
+		}
+	}
+	EXPECT_LE(table.stats().probeLengths.size(), 11u);
+}
+
+TEST(HashTable, seeded_hash_differs_per_table) {
+	SeededHash<int> first, second;
+	EXPECT_NE(first.seed, second.seed);
+	EXPECT_NE(first(42), second(42));
+	HashTable<std::string, int, Chaining, SeededHash<std::string>> table(4);
+	for (int i = 0; i < 100; i++) {
+		table.insert("key" + std::to_string(i), i);
+	}
+	HashTable<std::string, int, Chaining, SeededHash<std::string>> copy(table);
+	for (int i = 0; i < 100; i++) {
+		std::string key = "key" + std::to_string(i);
+		EXPECT_EQ(table[std::string_view(key)], i);
+		EXPECT_EQ(copy[key], i);
+	}
+}
+
+TEST(HashTable, can_rehash_with_several_threads) {
+	HashTable<std::string, int> table(16);
+	table.setRehashThreads(3);
+	for (int i = 0; i < 200000; i++) {
+		table.insert("key" + std::to_string(i), i);
+	}
+	table.rehash(300007);
+	EXPECT_EQ(table.size(), 200000);
+	for (int i = 0; i < 200000; i++) {
+		ASSERT_EQ(table["key" + std::to_string(i)], i);
+	}
+	HashTable<int, int, Chaining, PileHash> piled(4);
+	piled.setRehashThreads(4);
+	for (int i = 0; i < 100000; i++) {
+		piled.insert(i, i);
+	}
+	for (int i = 0; i < 100000; i++) {
+		ASSERT_EQ(piled[i], i);
+	}
+}
+
+TEST(HashTable, stable_chaining_keeps_references_across_rehash) {
+	HashTable<std::string, int, StableChaining> table(2);
+	table.insert("first", 1);
+	int* value = &table.find("first")->second;
+	const std::string* key = &table.find("first")->first;
+	for (int i = 0; i < 10000; i++) {
+		table.insert("key" + std::to_string(i), i);
+	}
+	table.rehash(50000);
+	table.remove("key5");
+	EXPECT_EQ(*key, "first");
+	*value = 7;
+	EXPECT_EQ(table["first"], 7);
+	HashTable<std::string, int, StableChaining> copy(table);
+	EXPECT_NE(&copy.find("first")->second, value);
+	EXPECT_EQ(copy["first"], 7);
+}
+
+struct CountingHash {
+	int* calls;
+	size_t operator()(const std::string& s) const {
+		++*calls;
+		return TableHash<std::string>()(s);
+	}
+};
+
+struct CountingEqual {
+	int* calls;
+	bool operator()(const std::string& a, const std::string& b) const {
+		++*calls;
+		return a == b;
+	}
+};
+
+TEST(HashTable, rehash_reuses_cached_hashes) {
+	int hashes = 0, compares = 0;
+	HashTable<std::string, int, Chaining, CountingHash, CountingEqual> table(1, CountingHash{ &hashes }, CountingEqual{ &compares });
+	table.max_load_factor(1000.0f);
+	for (int i = 0; i < 100; i++) {
+		table.insert(std::string(40, 'a') + std::to_string(i), i);
+	}
+	EXPECT_EQ(table.bucket_count(), 1u);
+	hashes = 0;
+	EXPECT_EQ(table.find(std::string(40, 'a') + "57")->second, 57);
+	EXPECT_EQ(hashes, 1);
+	EXPECT_EQ(compares, 1);
+	table.rehash(256);
+	table.balanceCollisions(64);
+	EXPECT_EQ(hashes, 1);
+	for (int i = 0; i < 100; i++) {
+		EXPECT_EQ(table[std::string(40, 'a') + std::to_string(i)], i);
+	}
+}
+
+TEST(ConcurrentHashTable, can_insert_and_find_from_threads) {
+	ConcurrentHashTable<int, int> table(64, 8);
+	EXPECT_EQ(table.shard_count(), 8u);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&table, t]() {
+			for (int i = t * 1000; i < (t + 1) * 1000; i++) {
+				table.insert(i, i * 2);
+				int value = 0;
+				EXPECT_TRUE(table.find(i, value) && value == i * 2);
+				// and one this thread inserted earlier, while others kept writing
+				int earlier = t * 1000 + (i - t * 1000) / 2;
+				EXPECT_TRUE(table.find(earlier, value) && value == earlier * 2);
+			}
+			for (int i = t * 1000; i < (t + 1) * 1000; i += 2) {
+				table.remove(i);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	EXPECT_EQ(table.size(), 2000u);
+	int value = 0;
+	EXPECT_TRUE(table.find(3001, value));
+	EXPECT_EQ(value, 6002);
+	EXPECT_FALSE(table.contains(3000));
+	EXPECT_FALSE(table.insert(3001, 0));
+	EXPECT_FALSE(table.insert_or_assign(3001, 7));
+	EXPECT_TRUE(table.find(3001, value));
+	EXPECT_EQ(value, 7);
+}
+
+TEST(ReadMostlyHashTable, readers_see_every_stable_key_while_writer_works) {
+	ReadMostlyHashTable<std::string, int> table(4, 8);
+	for (int i = 0; i < 100; i++) {
+		table.insert("stable" + std::to_string(i), i);
+	}
+	std::atomic<bool> done(false);
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 3; t++) {
+		readers.emplace_back([&table, &done]() {
+			while (!done) {
+				for (int i = 0; i < 100; i++) {
+					int value = -1;
+					ASSERT_TRUE(table.find("stable" + std::to_string(i), value));
+					ASSERT_EQ(value % 1000, i);
+				}
+			}
+		});
+	}
+	for (int round = 1; round < 20; round++) {
+		for (int i = 0; i < 500; i++) {
+			table.insert("churn" + std::to_string(i), i);
+		}
+		for (int i = 0; i < 100; i++) {
+			table.insert_or_assign("stable" + std::to_string(i), round * 1000 + i);
+		}
+		for (int i = 0; i < 500; i++) {
+			table.remove("churn" + std::to_string(i));
+		}
+	}
+	done = true;
+	for (auto& reader : readers) {
+		reader.join();
+	}
+	EXPECT_EQ(table.size(), 100u);
+	EXPECT_EQ(table["stable7"], 19007);
+	EXPECT_ANY_THROW(table["churn7"]);
+	EXPECT_FALSE(table.contains("churn7"));
+}
+
+TEST(RobinHoodHashTable, can_insert_and_find) {
+	HashTable<int, int, RobinHood> table(10);
+	for (int i = 0; i < 100; i++) {
+		table.insert(i, i * 2);
+	}
+	for (int i = 0; i < 100; i++) {
+		EXPECT_EQ(table.find(i)->second, i * 2);
+	}
+	EXPECT_EQ(table.size(), 100);
+	EXPECT_TRUE(table.find(100) == table.end());
+}
+
+TEST(RobinHoodHashTable, insert_keeps_existing_key) {
+	HashTable<std::string, int, RobinHood> table(4);
+	table.insert("gold", 1);
+	EXPECT_EQ(table.insert("gold", 2)->second, 1);
+	EXPECT_EQ(table.size(), 1);
+}
+
+TEST(RobinHoodHashTable, can_remove_with_backward_shift) {
+	HashTable<int, int, RobinHood> table(0);
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i, i);
+	}
+	for (int i = 0; i < 1000; i += 2) {
+		EXPECT_TRUE(table.remove(i));
+	}
+	EXPECT_FALSE(table.remove(0));
+	EXPECT_EQ(table.size(), 500);
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_EQ(table.find(i) != table.end(), i % 2 == 1);
+	}
+}
+
+TEST(RobinHoodHashTable, iterator_works_with_changes_in_values) {
+	HashTable<int, int, RobinHood> table(10);
+	for (int i = 0; i < 10; i++) {
+		table.insert(i, 1);
+	}
+	int n = 0;
+	for (auto it = table.begin(); it != table.end(); ++it) {
+		it->second++;
+		n++;
+	}
+	EXPECT_EQ(n, 10);
+	for (int i = 0; i < 10; i++) {
+		EXPECT_EQ(table[i], 2);
+	}
+	EXPECT_ANY_THROW(table[10]);
+}
+
+TEST(RobinHoodHashTable, can_copy_and_assign) {
+	HashTable<std::string, int, RobinHood> table(10);
+	table.insert("gold", 1);
+	table.insert("silver", 2);
+	HashTable<std::string, int, RobinHood> copy(table);
+	HashTable<std::string, int, RobinHood> other(1);
+	other.insert("platinum", 3);
+	other = table;
+	table.remove("gold");
+	EXPECT_EQ(copy["gold"], 1);
+	EXPECT_EQ(other["silver"], 2);
+	EXPECT_TRUE(other.find("platinum") == other.end());
+}
+
+TEST(GroupProbingHashTable, can_insert_and_find) {
+	HashTable<int, int, GroupProbing> table(10);
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i, i * 2);
+	}
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_EQ(table.find(i)->second, i * 2);
+	}
+	EXPECT_EQ(table.size(), 1000);
+	EXPECT_TRUE(table.find(-1) == table.end());
+}
+
+TEST(GroupProbingHashTable, can_remove) {
+	HashTable<std::string, int, GroupProbing> table(10);
+	table.insert("gold", 1);
+	table.insert("silver", 2);
+	table.insert("platinum", 3);
+	EXPECT_TRUE(table.remove("gold"));
+	EXPECT_FALSE(table.remove("gold"));
+	EXPECT_EQ(table["silver"], 2);
+	EXPECT_EQ(table["platinum"], 3);
+	EXPECT_ANY_THROW(table["gold"]);
+}
+
+TEST(GroupProbingHashTable, can_reuse_deleted_slots) {
+	HashTable<int, int, GroupProbing> table(0);
+	for (int round = 0; round < 50; round++) {
+		for (int i = 0; i < 100; i++) {
+			table.insert(round * 100 + i, i);
+		}
+		for (int i = 0; i < 100; i++) {
+			EXPECT_TRUE(table.remove(round * 100 + i));
+		}
+	}
+	EXPECT_EQ(table.size(), 0);
+	EXPECT_TRUE(table.begin() == table.end());
+}
+
+TEST(GroupProbingHashTable, iterator_works_with_changes_in_values) {
+	HashTable<int, int, GroupProbing> table(10);
+	for (int i = 0; i < 40; i++) {
+		table.insert(i, 1);
+	}
+	for (auto it = table.begin(); it != table.end(); ++it) {
+		it->second++;
+	}
+	for (int i = 0; i < 40; i++) {
+		EXPECT_EQ(table[i], 2);
+	}
+}
+
+TEST(GroupProbingHashTable, can_copy_and_assign) {
+	HashTable<int, int, GroupProbing> table(10);
+	table.insert(1, 1);
+	table.insert(2, 2);
+	HashTable<int, int, GroupProbing> copy(table);
+	table = table;
+	table.remove(1);
+	EXPECT_EQ(copy[1], 1);
+	EXPECT_EQ(table[2], 2);
+}
+
+TEST(CuckooHashTable, can_insert_and_find) {
+	HashTable<int, int, Cuckoo> table(10);
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i, i * 2);
+	}
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_EQ(table.find(i)->second, i * 2);
+	}
+	EXPECT_EQ(table.size(), 1000);
+	EXPECT_TRUE(table.find(-1) == table.end());
+}
+
+TEST(CuckooHashTable, can_fill_reserved_table_by_eviction) {
+	HashTable<int, int, Cuckoo> table(0);
+	table.reserve(4000);
+	size_t buckets = table.bucket_count();
+	int n = static_cast<int>(buckets * 9 / 10);
+	for (int i = 0; i < n; i++) {
+		table.insert(i * 7919, i);
+	}
+	EXPECT_EQ(table.bucket_count(), buckets);
+	for (int i = 0; i < n; i++) {
+		ASSERT_EQ(table[i * 7919], i);
+	}
+}
+
+TEST(CuckooHashTable, can_remove) {
+	HashTable<std::string, int, Cuckoo> table(10);
+	table.insert("gold", 1);
+	table.insert("silver", 2);
+	table.insert("platinum", 3);
+	EXPECT_TRUE(table.remove("gold"));
+	EXPECT_FALSE(table.remove("gold"));
+	EXPECT_EQ(table["silver"], 2);
+	EXPECT_EQ(table["platinum"], 3);
+	EXPECT_ANY_THROW(table["gold"]);
+}
+
+TEST(CuckooHashTable, iterator_works_with_changes_in_values) {
+	HashTable<int, int, Cuckoo> table(10);
+	for (int i = 0; i < 40; i++) {
+		table.insert(i, 1);
+	}
+	for (auto it = table.begin(); it != table.end(); ++it) {
+		it->second++;
+	}
+	for (int i = 0; i < 40; i++) {
+		EXPECT_EQ(table[i], 2);
+	}
+}
+
+TEST(CuckooHashTable, can_copy_and_assign) {
+	HashTable<int, int, Cuckoo> table(10);
+	table.insert(1, 1);
+	table.insert(2, 2);
+	HashTable<int, int, Cuckoo> copy(table);
+	table = table;
+	table.remove(1);
+	EXPECT_EQ(copy[1], 1);
+	EXPECT_EQ(table[2], 2);
+}
+
+TEST(FlatHashTable, can_insert_and_find) {
+	HashTable<long long, int, Flat> table(10);
+	for (int i = 0; i < 1000; i++) {
+		table.insert(i * 1000003LL, i);
+	}
+	for (int i = 0; i < 1000; i++) {
+		EXPECT_EQ(table.find(i * 1000003LL)->second, i);
+	}
+	EXPECT_EQ(table.size(), 1000);
+	EXPECT_TRUE(table.find(-1) == table.end());
+}
+
+TEST(FlatHashTable, throws_on_reserved_key) {
+	HashTable<int, int, Flat> table(10);
+	EXPECT_ANY_THROW(table.insert(FlatEmptyKey<int>::value(), 1));
+	EXPECT_TRUE(table.find(FlatEmptyKey<int>::value()) == table.end());
+	EXPECT_EQ(table.size(), 0);
+}
+
+enum class Color : unsigned char { Red, Green, Blue };
+enum Sign : int { Minus = -1, Zero };
+
+TEST(FlatHashTable, can_store_every_enumerator) {
+	HashTable<Color, int, Flat> table(4);
+	table.insert(Color::Red, 1);
+	table.insert(Color::Green, 2);
+	table.insert(Color::Blue, 3);
+	EXPECT_EQ(table.size(), 3);
+	EXPECT_EQ(table[Color::Red], 1);
+	EXPECT_EQ(table[Color::Green], 2);
+	EXPECT_EQ(table[Color::Blue], 3);
+	EXPECT_TRUE(table.remove(Color::Red));
+	EXPECT_TRUE(table.find(Color::Red) == table.end());
+	EXPECT_ANY_THROW(table.insert(FlatEmptyKey<Color>::value(), 4));
+	HashTable<Sign, int, Flat> signs(4);
+	signs.insert(Sign::Minus, -1);
+	signs.insert(Sign::Zero, 0);
+	EXPECT_EQ(signs[Sign::Minus], -1);
+	EXPECT_EQ(signs[Sign::Zero], 0);
+}
+
+TEST(FlatHashTable, remove_keeps_other_keys_reachable) {
+	HashTable<int, int, Flat> table(0);
+	std::map<int, int> expected;
+	std::mt19937 random(7);
+	for (int i = 0; i < 20000; i++) {
+		int key = static_cast<int>(random() % 500);
+		if (random() % 2) {
+			table.insert_or_assign(key, i);
+			expected[key] = i;
+		}
+		else {
+			EXPECT_EQ(table.remove(key), expected.erase(key) == 1);
+		}
+	}
+	EXPECT_EQ(table.size(), expected.size());
+	for (auto& item : expected) {
+		ASSERT_EQ(table[item.first], item.second);
+	}
+}
+
+TEST(FlatHashTable, iterator_works_with_changes_in_values) {
+	HashTable<int, int, Flat> table(10);
+	for (int i = 0; i < 40; i++) {
+		table.insert(i, 1);
+	}
+	for (auto it = table.begin(); it != table.end(); ++it) {
+		it->second++;
+	}
+	for (int i = 0; i < 40; i++) {
+		EXPECT_EQ(table[i], 2);
+	}
+}
+
+TEST(FlatHashTable, can_copy_and_assign) {
+	HashTable<int, std::string, Flat> table(10);
+	table.insert(1, "one");
+	table.insert(2, "two");
+	HashTable<int, std::string, Flat> copy(table);
+	table = table;
+	table.remove(1);
+	EXPECT_EQ(copy[1], "one");
+	EXPECT_EQ(table[2], "two");
+}
+
+TEST(MembershipFilter, bloom_and_xor_filters_have_no_false_negatives) {
+	std::vector<uint64_t> hashes;
+	for (int i = 0; i < 10000; i++) {
+		hashes.push_back(TableHash<int>()(i));
+	}
+	BlockedBloomFilter bloom;
+	bloom.build(hashes);
+	XorFilter xorFilter;
+	xorFilter.build(hashes);
+	int bloomPositives = 0, xorPositives = 0;
+	for (int i = 0; i < 20000; i++) {
+		uint64_t h = TableHash<int>()(i);
+		if (i < 10000) {
+			ASSERT_TRUE(bloom.mayContain(h));
+			ASSERT_TRUE(xorFilter.mayContain(h));
+		}
+		else {
+			bloomPositives += bloom.mayContain(h);
+			xorPositives += xorFilter.mayContain(h);
+		}
+	}
+	EXPECT_LT(bloomPositives, 200);
+	EXPECT_LT(xorPositives, 200);
+}
+
+template <typename Table>
+void checkFilteredTable(FilteredTable<int, int, Table>& table) {
+	for (int i = 0; i < 500; i++) {
+		table.insert(i * 2, i);
+	}
+	for (int i = 0; i < 500; i++) {
+		ASSERT_TRUE(table.contains(i * 2));
+		EXPECT_EQ(table[i * 2], i);
+		EXPECT_FALSE(table.contains(i * 2 + 1));
+	}
+	for (int i = 0; i < 400; i++) {
+		table.remove(i * 2);
+	}
+	for (int i = 0; i < 500; i++) {
+		EXPECT_EQ(table.contains(i * 2), i >= 400);
+	}
+}
+
+TEST(FilteredTable, works_in_front_of_every_table) {
+	FilteredTable<int, int, HashTable<int, int>> hashTable(8);
+	checkFilteredTable(hashTable);
+	FilteredTable<int, int, HashTable<int, int, Cuckoo>> cuckooTable(8);
+	checkFilteredTable(cuckooTable);
+	FilteredTable<int, int, SortTable<int, int>> sortTable;
+	checkFilteredTable(sortTable);
+	FilteredTable<int, int, AVLTree<int, int>> avlTree;
+	EXPECT_FALSE(avlTree.contains(1));
+	avlTree.insert(1, 10);
+	EXPECT_EQ(avlTree[1], 10);
+	EXPECT_TRUE(avlTree.find(2) == nullptr);
+}
+
+TEST(FilteredTable, counts_only_keys_actually_removed) {
+	FilteredTable<int, int> table(8);
+	for (int i = 0; i < 10; i++) {
+		table.insert(i, i);
+	}
+	// repeated removals of one key must not add up to a rebuild, which
+	// would drop it from the Bloom filter
+	for (int i = 0; i < 10; i++) {
+		table.remove(0);
+	}
+	EXPECT_TRUE(table.mayContain(0));
+	EXPECT_FALSE(table.contains(0));
+	for (int i = 1; i < 10; i++) {
+		EXPECT_EQ(table[i], i);
+	}
+}
+
+TEST(FilteredTable, can_freeze_with_xor_filter) {
+	FilteredTable<std::string, int, HashTable<std::string, int, RobinHood>, XorFilter> table(8);
+	for (int i = 0; i < 100; i++) {
+		table.table().insert("key" + std::to_string(i), i);
+	}
+	table.rebuild();
+	for (int i = 0; i < 100; i++) {
+		EXPECT_EQ(table["key" + std::to_string(i)], i);
+	}
+	EXPECT_FALSE(table.contains("key100"));
+	EXPECT_ANY_THROW(table["missing"]);
+}
+
+TEST(FrozenTable, finds_every_key_of_a_frozen_hash_table) {
+	HashTable<std::string, int, GroupProbing> table(8);
+	for (int i = 0; i < 5000; i++) {
+		table.insert("key" + std::to_string(i), i);
+	}
+	FrozenTable<std::string, int> frozen = freeze(table);
+	EXPECT_EQ(frozen.size(), 5000);
+	for (int i = 0; i < 5000; i++) {
+		ASSERT_EQ(frozen["key" + std::to_string(i)], i);
+	}
+	EXPECT_FALSE(frozen.contains("key5000"));
+	EXPECT_TRUE(frozen.find("missing") == nullptr);
+	EXPECT_ANY_THROW(frozen["missing"]);
+}
+
+TEST(FrozenTable, keeps_the_policies_of_a_frozen_hash_table) {
+	int hashes = 0, compares = 0;
+	HashTable<std::string, int, Chaining, CountingHash, CountingEqual> table(8, CountingHash{ &hashes }, CountingEqual{ &compares });
+	for (int i = 0; i < 100; i++) {
+		table.insert("key" + std::to_string(i), i);
+	}
+	EXPECT_EQ(table.hash_function().calls, &hashes);
+	EXPECT_EQ(table.key_eq().calls, &compares);
+	FrozenTable<std::string, int, CountingHash, CountingEqual> frozen = freeze(table);
+	hashes = compares = 0;
+	EXPECT_EQ(frozen["key42"], 42);
+	EXPECT_EQ(hashes, 1);
+	EXPECT_EQ(compares, 1);
+}
+
+TEST(FrozenTable, can_freeze_every_table) {
+	SortTable<int, int> sortTable;
+	RBTree<int, int> tree;
+	for (int i = 0; i < 100; i++) {
+		sortTable.insert(i, i * 2);
+		tree.insert(i, i * 3);
+	}
+	FrozenTable<int, int> fromSort = freeze(sortTable), fromTree = freeze(tree);
+	for (int i = 0; i < 100; i++) {
+		EXPECT_EQ(fromSort[i], i * 2);
+		EXPECT_EQ(fromTree[i], i * 3);
+	}
+	EXPECT_TRUE(fromTree.find(100) == nullptr);
+	HashTable<int, int> empty(4);
+	EXPECT_FALSE(freeze(empty).contains(0));
+}
+
+struct HalfHash {
+	size_t operator()(int key) const {
+		return static_cast<size_t>(key / 2);
+	}
+};
+
+TEST(FrozenTable, keeps_the_first_of_duplicate_keys) {
+	HashTable<int, int> table(8);
+	SimpleTable<int, int> simpleTable;
+	for (int i = 0; i < 100; i++) {
+		table.insert(i % 40, i);
+		simpleTable.insert(i % 40, i);
+	}
+	FrozenTable<int, int> frozen = freeze(table), fromSimple = freeze(simpleTable);
+	EXPECT_EQ(frozen.size(), 40);
+	EXPECT_EQ(fromSimple.size(), 40);
+	for (int i = 0; i < 40; i++) {
+		EXPECT_EQ(frozen[i], table[i]);
+		EXPECT_EQ(fromSimple[i], i);
+	}
+	// different keys with one hash still cannot be told apart
+	std::vector<std::pair<int, int>> items = { { 0, 0 }, { 0, 1 }, { 1, 2 } };
+	EXPECT_THROW((FrozenTable<int, int, HalfHash>(items)), std::runtime_error);
+	items.pop_back();
+	FrozenTable<int, int, HalfHash> single(items);
+	EXPECT_EQ(single.size(), 1);
+	EXPECT_EQ(single[0], 0);
+}
+
+TEST(ArenaString, compares_like_std_string) {
+	std::vector<std::string> words = { "", "a", "ab", "abcd", "abcde", "abcdf", "abce", std::string("ab\0", 3), "b", "\xff" };
+	for (const std::string& x : words) {
+		for (const std::string& y : words) {
+			ArenaString a(x), b(y);
+			EXPECT_EQ(a == b, x == y);
+			EXPECT_EQ(a < b, x < y);
+			EXPECT_EQ(a > y, x > y);
+			EXPECT_EQ(x <= b, x <= y);
+			EXPECT_EQ(TableHash<ArenaString>()(b), TableHash<ArenaString>()(y));
+		}
+	}
+	StringArena arena;
+	ArenaString first = ArenaString::interned("https://example.com/", arena);
+	ArenaString second = ArenaString::interned(std::string("https://example.com/"), arena);
+	EXPECT_EQ(first.data(), second.data());
+	EXPECT_NE(ArenaString("https://example.com/", arena).data(), first.data());
+	if (sizeof(size_t) > sizeof(uint32_t)) {
+		// never read: the length is refused first
+		std::string_view huge(first.data(), static_cast<size_t>(UINT32_MAX) + 1);
+		EXPECT_THROW(ArenaString::borrowed(huge), std::runtime_error);
+		EXPECT_THROW(ArenaString(huge, arena), std::runtime_error);
+	}
+}
+
+TEST(ArenaString, works_as_key_of_every_table) {
+	// a plain string must not become a key (and an arena copy) silently
+	static_assert(!std::is_convertible<std::string, ArenaString>::value, "implicit ArenaString");
+	static_assert(!std::is_convertible<const char*, ArenaString>::value, "implicit ArenaString");
+	static_assert(!std::is_convertible<std::string_view, ArenaString>::value, "implicit ArenaString");
+	StringArena arena;
+	HashTable<ArenaString, int> hashTable(4);
+	SortTable<ArenaString, int> sortTable;
+	SimpleTable<ArenaString, int> simpleTable;
+	AVLTree<ArenaString, int> tree;
+	for (int i = 0; i < 200; i++) {
+		ArenaString key("/page/" + std::to_string(i), arena);
+		hashTable.insert(key, i);
+		sortTable.insert(key, i);
+		simpleTable.insert(key, i);
+		tree.insert(key, i);
+	}
+	size_t reserved = StringArena::shared().reserved();
+	for (int i = 0; i < 200; i++) {
+		std::string url = "/page/" + std::to_string(i);
+		ASSERT_EQ(hashTable[url], i);
+		ASSERT_EQ(sortTable[url], i);
+		ASSERT_EQ(simpleTable[ArenaString::borrowed(url)], i);
+		ASSERT_EQ(tree.lookup(ArenaString::borrowed(url))->value, i);
+	}
+	EXPECT_TRUE(hashTable.find("/page/200") == hashTable.end());
+	EXPECT_TRUE(hashTable.remove("/page/7"));
+	EXPECT_EQ(StringArena::shared().reserved(), reserved);
+	EXPECT_EQ(sortTable.begin().getPtr()->first, "/page/0");
+}
+
+TEST(BoundedTable, clock_evicts_entries_not_used_since_the_last_lap) {
+	BoundedTable<std::string, int> cache(3);
+	EXPECT_TRUE(cache.insert("a", 1));
+	EXPECT_TRUE(cache.insert("b", 2));
+	EXPECT_TRUE(cache.insert("c", 3));
+	EXPECT_FALSE(cache.insert("a", 10));
+	EXPECT_EQ(*cache.find("a"), 1);
+	EXPECT_TRUE(cache.insert("d", 4));
+	EXPECT_EQ(cache.size(), 3);
+	EXPECT_EQ(cache.evictions(), 1);
+	EXPECT_FALSE(cache.contains("b"));
+	EXPECT_TRUE(cache.contains("a"));
+	EXPECT_TRUE(cache.contains("c"));
+	EXPECT_EQ(cache["d"], 4);
+	EXPECT_TRUE(cache.remove("c"));
+	EXPECT_FALSE(cache.remove("c"));
+	EXPECT_TRUE(cache.find("c") == nullptr);
+	EXPECT_THROW(cache["c"], std::runtime_error);
+	EXPECT_FALSE(cache.insert_or_assign("a", 5));
+	EXPECT_EQ(cache["a"], 5);
+	EXPECT_ANY_THROW((BoundedTable<int, int>(0)));
+}
+
+template <typename Eviction>
+size_t hotMisses() {
+	BoundedTable<int, int, Eviction> cache(100);
+	size_t misses = 0;
+	for (int i = 0; i < 20000; i++) {
+		// a hot set of 50 keys, read twice each, under a scan of one-off keys
+		int hot = i % 50;
+		for (int read = 0; read < 2; read++) {
+			if (cache.find(hot) == nullptr) {
+				misses++;
+				cache.insert(hot, hot);
+			}
+		}
+		cache.insert(1000 + i, i);
+		cache.insert(100000 + i, i);
+	}
+	EXPECT_EQ(cache.size(), 100);
+	return misses;
+}
+
+TEST(BoundedTable, segmented_lru_keeps_hot_keys_through_a_scan) {
+	size_t clock = hotMisses<ClockEviction>(), segmented = hotMisses<SegmentedLru>();
+	EXPECT_LT(segmented, clock);
+	EXPECT_LT(segmented, 100u);
+}
+
+TEST(BoundedTable, stays_within_a_byte_budget) {
+	BoundedTable<std::string, std::string> cache(0, 4096);
+	for (int i = 0; i < 1000; i++) {
+		cache.insert("key" + std::to_string(i), std::string(i % 100, 'v'));
+		ASSERT_LE(cache.bytes(), 4096u);
+	}
+	EXPECT_GT(cache.evictions(), 900u);
+	EXPECT_TRUE(cache.contains("key999"));
+	cache.insert_or_assign("key999", std::string(10000, 'v'));
+	EXPECT_EQ(cache.size(), 1);
+	EXPECT_EQ(cache["key999"].size(), 10000);
+}
+
+// Every string in one bucket, so evictions shift the chain of the key kept
+struct ConstantHash {
+	size_t operator()(const std::string&) const {
+		return 0;
+	}
+};
+
+TEST(BoundedTable, assign_keeps_its_entry_when_evicting_from_its_chain) {
+	for (const char* kept : { "b", "d" }) {
+		BoundedTable<std::string, std::string, ClockEviction, ConstantHash> cache(0, 1000);
+		for (const char* key : { "a", "b", "c", "d" }) {
+			cache.insert(key, std::string(100, 'x'));
+		}
+		EXPECT_FALSE(cache.insert_or_assign(kept, std::string(850, 'y')));
+		EXPECT_TRUE(cache.contains(kept));
+		EXPECT_EQ(cache[kept].size(), 850);
+		EXPECT_LE(cache.bytes(), 1000u);
+		size_t bytes = 0;
+		for (const char* key : { "a", "b", "c", "d" }) {
+			if (cache.contains(key)) {
+				bytes += EntryWeight<std::string, std::string>()(key, *cache.find(key));
+			}
+		}
+		EXPECT_EQ(cache.bytes(), bytes);
+	}
+}
+
 TEST(BinaryTree, can_insert){
 	BinaryTree<int, int> tree;
 	tree.insert(2,3);
@@ -326,6 +1626,28 @@ TEST(BinaryTree, can_insert_random_values) {
 	}
 }
 
+TEST(BinaryTree, can_find_by_string_view) {
+	BinaryTree<std::string, int> tree;
+	tree.insert("gold", 1);
+	tree.insert("silver", 2);
+	tree.insert("copper", 3);
+	EXPECT_EQ(tree.find(std::string_view("silver"))->value, 2);
+	tree.remove("copper");
+	EXPECT_EQ(tree.sizeTree(), 2);
+}
+
+TEST(BinaryTree, can_emplace_move_only_values) {
+	BinaryTree<int, std::unique_ptr<int>> tree;
+	for (int i : {5, 2, 8, 1}) {
+		EXPECT_TRUE(tree.try_emplace(i, new int(i)).second);
+	}
+	EXPECT_FALSE(tree.try_emplace(2, std::unique_ptr<int>(new int(0))).second);
+	EXPECT_FALSE(tree.insert_or_assign(8, std::unique_ptr<int>(new int(80))).second);
+	EXPECT_EQ(*tree.find(2)->value, 2);
+	EXPECT_EQ(*tree.find(8)->value, 80);
+	EXPECT_EQ(tree.sizeTree(), 4);
+}
+
 TEST(AVLTree, can_it_get_height_and_balance) {
     AVLTree<int, int> avl;
     avl.insert(10, 100);
@@ -503,6 +1825,27 @@ TEST(AVLTree, iterator_works_with_changes_in_values_big_tree) {
 
 }
 
+TEST(AVLTree, can_find_by_string_view) {
+	AVLTree<std::string, int> tree;
+	tree.insert("gold", 1);
+	tree.insert("silver", 2);
+	tree.insert("copper", 3);
+	EXPECT_EQ(tree.find(std::string_view("copper"))->value, 3);
+	EXPECT_EQ(tree.find("gold")->value, 1);
+}
+
+TEST(AVLTree, can_emplace_values) {
+	AVLTree<int, std::string> avl;
+	for (int i = 0; i < 100; i++) {
+		avl.emplace(i, 3, 'a');
+	}
+	EXPECT_FALSE(avl.try_emplace(50, "b").second);
+	EXPECT_TRUE(avl.try_emplace(100, "c").second);
+	EXPECT_EQ(avl.find(50)->value, "aaa");
+	EXPECT_EQ(avl.find(100)->value, "c");
+	EXPECT_EQ(avl.sizeTree(), 101);
+}
+
 TEST(Binary_and_AVL_Trees, time_insert_random_values) {
 	AVLTree<int, int> avl;
 	BinaryTree<int, int> tree;
@@ -587,6 +1930,30 @@ TEST(RBTree, can_insert_and_find) {
     EXPECT_EQ(rbTree.find(35)->value, 35);
 }
 
+TEST(RBTree, can_find_by_string_view) {
+	RBTree<std::string, int> tree;
+	tree.insert("gold", 1);
+	tree.insert("silver", 2);
+	tree.insert("copper", 3);
+	EXPECT_EQ(tree.find(std::string_view("silver"))->value, 2);
+	tree.remove(std::string_view("silver"));
+	EXPECT_EQ(tree.find("silver"), nullptr);
+	EXPECT_EQ(tree.sizeTree(), 2);
+}
+
+TEST(RBTree, emplace_ignores_duplicate_keys) {
+	RBTree<std::string, std::string> tree;
+	for (int i = 0; i < 50; i++) {
+		tree.emplace(std::to_string(i), 2, 'a');
+	}
+	EXPECT_EQ(tree.emplace(std::string("7"), "x")->value, "aa");
+	EXPECT_FALSE(tree.try_emplace("7", "y").second);
+	EXPECT_FALSE(tree.insert_or_assign("7", "z").second);
+	EXPECT_TRUE(tree.insert_or_assign("50", "w").second);
+	EXPECT_EQ(tree.find("7")->value, "z");
+	EXPECT_EQ(tree.sizeTree(), 51);
+}
+
 TEST(RBTree, can_get_size) {
     RBTree<int, int> rbTree;
     rbTree.insert(10, 10);